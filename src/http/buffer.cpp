@@ -1,26 +1,183 @@
 #include "buffer.h"
 
+#include <cstring>
+#include <algorithm>
+
 using namespace http;
 
-buffer::buffer(char *buff, size_t size) noexcept :
-    _buff(buff),
-    _buff_size(size)
+buffer::buffer(char *data, size_t size)
+{
+    if (data != nullptr) {
+        _block.reset(data, std::default_delete<char[]>());
+        _data = data;
+        _size = size;
+    }
+}
+
+buffer::buffer(char *data, size_t size, buffer_deleter deleter)
+{
+    if (data != nullptr) {
+        _block.reset(data, [deleter, size](const char* block) { deleter(const_cast<char*>(block), size); });
+        _data = data;
+        _size = size;
+    }
+}
+
+buffer buffer::copy(const char *data, size_t size)
 {
+    if (size == 0) {
+        return buffer();
+    }
+
+    char* block = new char[size];
+    memcpy(block, data, size);
+    return buffer(block, size);
 }
 
-buffer::~buffer()
+buffer buffer::from_string(std::string &&str)
 {
-    if (_buff != nullptr && _buff_size > 0) {
-        delete[] _buff;
+    if (str.empty()) {
+        return buffer();
     }
+
+    // a short string lives in the object, so it's kept on the heap with the block
+    auto owner = std::make_shared<std::string>(std::move(str));
+    buffer res;
+    res._data = owner->data();
+    res._size = owner->size();
+    res._block = std::shared_ptr<const char>(owner, owner->data());
+    return res;
 }
 
 size_t buffer::size() const noexcept
 {
-    return _buff_size;
+    return _size;
 }
 
 const char *buffer::data() const noexcept
 {
-    return _buff;
+    return _data;
+}
+
+bool buffer::empty() const noexcept
+{
+    return _size == 0;
+}
+
+buffer buffer::slice(size_t offset, size_t size) const noexcept
+{
+    buffer res;
+    if (offset >= _size) {
+        return res;
+    }
+
+    res._block = _block;
+    res._data = _data + offset;
+    res._size = std::min(size, _size - offset);
+    return res;
+}
+
+long buffer::use_count() const noexcept
+{
+    return _block.use_count();
+}
+
+buffer_chain::buffer_chain(std::initializer_list<buffer> buffers)
+{
+    _buffers.reserve(buffers.size());
+    for (auto&& buff : buffers) {
+        append(buff);
+    }
+}
+
+void buffer_chain::append(buffer buff)
+{
+    if (buff.empty()) {
+        return;
+    }
+
+    _size += buff.size();
+    _buffers.push_back(std::move(buff));
+}
+
+void buffer_chain::append(const buffer_chain &chain)
+{
+    _buffers.reserve(_buffers.size() + chain.count());
+    for (auto&& buff : chain) {
+        append(buff);
+    }
+}
+
+void buffer_chain::clear() noexcept
+{
+    _buffers.clear();
+    _size = 0;
+}
+
+size_t buffer_chain::size() const noexcept
+{
+    return _size;
+}
+
+bool buffer_chain::empty() const noexcept
+{
+    return _size == 0;
+}
+
+size_t buffer_chain::count() const noexcept
+{
+    return _buffers.size();
+}
+
+const buffer &buffer_chain::operator[](size_t i) const noexcept
+{
+    return _buffers[i];
+}
+
+std::vector<buffer>::const_iterator buffer_chain::begin() const noexcept
+{
+    return _buffers.begin();
+}
+
+std::vector<buffer>::const_iterator buffer_chain::end() const noexcept
+{
+    return _buffers.end();
+}
+
+buffer_chain buffer_chain::slice(size_t offset, size_t size) const
+{
+    buffer_chain res;
+    for (auto&& buff : _buffers) {
+        if (size == 0) {
+            break;
+        }
+        if (offset >= buff.size()) {
+            offset -= buff.size();
+            continue;
+        }
+
+        buffer part = buff.slice(offset, size);
+        size -= part.size();
+        offset = 0;
+        res.append(std::move(part));
+    }
+    return res;
+}
+
+buffer buffer_chain::flatten() const
+{
+    if (_buffers.size() == 1) {
+        return _buffers[0];
+    }
+    if (_size == 0) {
+        return buffer();
+    }
+
+    char* block = new char[_size];
+    size_t pos = 0;
+    for (auto&& buff : _buffers) {
+        memcpy(block + pos, buff.data(), buff.size());
+        pos += buff.size();
+    }
+    return buffer(block, _size);
 }
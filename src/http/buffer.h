@@ -1,25 +1,74 @@
 #ifndef BUFFER_H
 #define BUFFER_H
 
+#include <memory>
 #include <string>
+#include <vector>
+#include <functional>
 
 namespace http {
 
+// releases a block of bytes, e.g. by munmap or by returning it to a pool
+typedef std::function<void(char* data, size_t size)> buffer_deleter;
+
+// Refcounted immutable bytes. Copies and slices share one block without
+// copying it, the block is released by its deleter when the last of them is gone.
 class buffer
 {
 public:
-    buffer(char* buff, size_t size) noexcept;
+    buffer() noexcept = default;
+    // takes an array allocated by new[]
+    buffer(char* data, size_t size);
+    buffer(char* data, size_t size, buffer_deleter deleter);
 
-    ~buffer();
+    static buffer copy(const char* data, size_t size);
+    // the string is moved into the block
+    static buffer from_string(std::string&& str);
 
     size_t size() const noexcept;
     const char* data() const noexcept;
+    bool empty() const noexcept;
+
+    // a view of size bytes from offset in the same block, it's cut at the end of this one
+    buffer slice(size_t offset, size_t size) const noexcept;
+    // the number of buffers which share the block
+    long use_count() const noexcept;
 
 private:
-    std::string _str;
+    std::shared_ptr<const char> _block;
+    const char* _data = nullptr;
+    size_t _size = 0;
+};
+
+// Sequence of buffers sent as one body, e.g. shared segments with
+// a per-request header before them. Nothing is copied to join them.
+class buffer_chain
+{
+public:
+    buffer_chain() noexcept = default;
+    buffer_chain(std::initializer_list<buffer> buffers);
 
-    char* _buff = nullptr;
-    size_t _buff_size = 0;
+    void append(buffer buff);
+    void append(const buffer_chain& chain);
+    void clear() noexcept;
+
+    // the total size of the buffers
+    size_t size() const noexcept;
+    bool empty() const noexcept;
+
+    size_t count() const noexcept;
+    const buffer& operator[](size_t i) const noexcept;
+    std::vector<buffer>::const_iterator begin() const noexcept;
+    std::vector<buffer>::const_iterator end() const noexcept;
+
+    // size bytes from offset over the buffers, the slices share their blocks
+    buffer_chain slice(size_t offset, size_t size) const;
+    // joins the buffers into one, a single buffer is returned as is
+    buffer flatten() const;
+
+private:
+    std::vector<buffer> _buffers;
+    size_t _size = 0;
 };
 
 }
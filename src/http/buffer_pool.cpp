@@ -0,0 +1,133 @@
+#include "buffer_pool.h"
+
+#include <cstdio>
+#include <algorithm>
+
+#include <sys/mman.h>
+
+using namespace http;
+
+buffer_pool::buffer_pool(size_t buff_size,
+                         size_t high_water_mark,
+                         bool huge_pages) noexcept :
+    _buff_size(std::max(buff_size, sizeof(free_node))),
+    _high_water_mark(high_water_mark),
+    _huge_pages(huge_pages)
+{
+}
+
+buffer_pool::~buffer_pool()
+{
+    while (_free != nullptr) {
+        char* buff = reinterpret_cast<char*>(_free);
+        _free = _free->next;
+        if (!from_slab(buff)) {
+            delete[] buff;
+        }
+    }
+
+    for (auto&& s : _slabs) {
+        munmap(s.data, s.size);
+    }
+}
+
+char *buffer_pool::acquire() noexcept
+{
+    if (_free == nullptr && _huge_pages) {
+        add_slab();
+    }
+
+    char* buff = nullptr;
+    if (_free != nullptr) {
+        buff = reinterpret_cast<char*>(_free);
+        _free = _free->next;
+        --_free_size;
+        stats_increment(_hits);
+    } else {
+        buff = new char[_buff_size];
+        stats_increment(_misses);
+    }
+
+    _free_size_stat.store(_free_size, std::memory_order_relaxed);
+    return buff;
+}
+
+void buffer_pool::release(char *buff) noexcept
+{
+    if (buff == nullptr) {
+        return;
+    }
+
+    if (_free_size < _high_water_mark || from_slab(buff)) {
+        push(buff);
+    } else {
+        delete[] buff;
+    }
+
+    _free_size_stat.store(_free_size, std::memory_order_relaxed);
+}
+
+size_t buffer_pool::buff_size() const noexcept
+{
+    return _buff_size;
+}
+
+pool_stats buffer_pool::stats() const noexcept
+{
+    pool_stats res;
+    res.hits = _hits.load(std::memory_order_relaxed);
+    res.misses = _misses.load(std::memory_order_relaxed);
+    res.free_size = _free_size_stat.load(std::memory_order_relaxed);
+    return res;
+}
+
+bool buffer_pool::add_slab() noexcept
+{
+    // slabs are a part of the high-water mark too
+    if (_slabs.size() * (slab_size / _buff_size) >= _high_water_mark) {
+        return false;
+    }
+
+    void* data = mmap(nullptr, slab_size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (data == MAP_FAILED) {
+        // there are no reserved huge pages, so ask for transparent ones
+        data = mmap(nullptr, slab_size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (data == MAP_FAILED) {
+            perror("mmap buffer slab");
+            return false;
+        }
+        madvise(data, slab_size, MADV_HUGEPAGE);
+    }
+
+    slab s;
+    s.data = static_cast<char*>(data);
+    s.size = slab_size;
+    _slabs.push_back(s);
+
+    const size_t buffs_num = slab_size / _buff_size;
+    for (size_t i=0; i<buffs_num; ++i) {
+        push(s.data + i*_buff_size);
+    }
+
+    return true;
+}
+
+bool buffer_pool::from_slab(const char *buff) const noexcept
+{
+    for (auto&& s : _slabs) {
+        if (buff >= s.data && buff < s.data + s.size) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void buffer_pool::push(char *buff) noexcept
+{
+    free_node* node = reinterpret_cast<free_node*>(buff);
+    node->next = _free;
+    _free = node;
+    ++_free_size;
+}
@@ -0,0 +1,66 @@
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <atomic>
+#include <vector>
+#include <cstddef>
+
+#include "stats.h"
+
+namespace http {
+
+// Free list of fixed size I/O buffers. With huge_pages buffers are cut
+// from 2 MB slabs backed by huge pages and are kept until the pool dies.
+// It isn't thread safe and belongs to one worker, only stats can be read from other threads.
+class buffer_pool
+{
+public:
+    buffer_pool(size_t buff_size, size_t high_water_mark, bool huge_pages) noexcept;
+    ~buffer_pool();
+
+    buffer_pool(const buffer_pool&) = delete;
+    buffer_pool& operator=(const buffer_pool&) = delete;
+
+    char* acquire() noexcept;
+    void release(char* buff) noexcept;
+
+    size_t buff_size() const noexcept;
+    pool_stats stats() const noexcept;
+
+private:
+    struct free_node
+    {
+        free_node* next;
+    };
+
+    struct slab
+    {
+        char* data = nullptr;
+        size_t size = 0;
+    };
+
+    bool add_slab() noexcept;
+    bool from_slab(const char* buff) const noexcept;
+
+    void push(char* buff) noexcept;
+
+private:
+    const size_t slab_size = 2*1024*1024;
+
+    size_t _buff_size = 0;
+    size_t _high_water_mark = 0;
+    bool _huge_pages = false;
+
+    free_node* _free = nullptr;
+    size_t _free_size = 0;
+
+    std::vector<slab> _slabs;
+
+    std::atomic<size_t> _hits = 0;
+    std::atomic<size_t> _misses = 0;
+    std::atomic<size_t> _free_size_stat = 0;
+};
+
+}
+
+#endif // BUFFER_POOL_H
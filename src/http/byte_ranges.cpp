@@ -0,0 +1,119 @@
+#include "byte_ranges.h"
+
+#include <cstring>
+#include <algorithm>
+
+#include <strings.h>
+
+using namespace http;
+
+namespace {
+
+// more ranges than this look like an attack rather than a player
+const size_t max_ranges_num = 16;
+
+bool parse_number(const char*& pos, const char* end, uint64_t& number) noexcept
+{
+    const char* begin = pos;
+    number = 0;
+    while (pos < end && *pos >= '0' && *pos <= '9') {
+        if (number > (UINT64_MAX - 9) / 10) {
+            return false;
+        }
+        number = number * 10 + static_cast<uint64_t>(*pos - '0');
+        ++pos;
+    }
+    return pos != begin;
+}
+
+void skip_spaces(const char*& pos, const char* end) noexcept
+{
+    while (pos < end && (*pos == ' ' || *pos == '\t')) {
+        ++pos;
+    }
+}
+
+}
+
+range_status http::parse_byte_ranges(string value, uint64_t body_size, byte_ranges &ranges) noexcept
+{
+    ranges.clear();
+
+    const char prefix[] = "bytes=";
+    const size_t prefix_size = sizeof(prefix) - 1;
+    if (value.size() <= prefix_size || strncasecmp(value.data(), prefix, prefix_size) != 0) {
+        return range_status::none;
+    }
+
+    const char* pos = value.data() + prefix_size;
+    const char* end = value.data() + value.size();
+    size_t specs_num = 0;
+
+    while (pos < end) {
+        skip_spaces(pos, end);
+        if (pos < end && *pos == ',') {
+            ++pos;
+            continue;
+        }
+        if (pos == end) {
+            break;
+        }
+
+        if (++specs_num > max_ranges_num) {
+            return range_status::none;
+        }
+
+        uint64_t first = 0;
+        uint64_t last = 0;
+        byte_range range;
+        bool satisfiable = false;
+
+        if (*pos == '-') {
+            // the suffix of the body
+            ++pos;
+            if (!parse_number(pos, end, last)) {
+                return range_status::none;
+            }
+            if (last > 0 && body_size > 0) {
+                range.size = std::min(last, body_size);
+                range.offset = body_size - range.size;
+                satisfiable = true;
+            }
+        } else {
+            if (!parse_number(pos, end, first) || pos == end || *pos != '-') {
+                return range_status::none;
+            }
+            ++pos;
+
+            const char* last_pos = pos;
+            if (parse_number(pos, end, last)) {
+                if (last < first) {
+                    return range_status::none;
+                }
+            } else {
+                pos = last_pos;
+                last = UINT64_MAX;
+            }
+
+            if (first < body_size) {
+                range.offset = first;
+                range.size = std::min(last, body_size - 1) - first + 1;
+                satisfiable = true;
+            }
+        }
+
+        skip_spaces(pos, end);
+        if (pos < end && *pos != ',') {
+            return range_status::none;
+        }
+
+        if (satisfiable) {
+            ranges.push_back(range);
+        }
+    }
+
+    if (specs_num == 0) {
+        return range_status::none;
+    }
+    return ranges.empty() ? range_status::unsatisfiable : range_status::satisfiable;
+}
@@ -0,0 +1,33 @@
+#ifndef BYTE_RANGES_H
+#define BYTE_RANGES_H
+
+#include <cstdint>
+
+#include "str.h"
+#include "small_vector.h"
+
+namespace http {
+
+struct byte_range
+{
+    uint64_t offset = 0;
+    uint64_t size = 0;
+};
+
+typedef small_vector<byte_range, 4> byte_ranges;
+
+enum class range_status
+{
+    // there is no valid Range, the whole body is sent
+    none,
+    satisfiable,
+    unsatisfiable
+};
+
+// parses a Range value like bytes=0-99,500-,-100 against the body size,
+// ranges are clamped to the body and unsatisfiable ones are skipped
+range_status parse_byte_ranges(string value, uint64_t body_size, byte_ranges& ranges) noexcept;
+
+}
+
+#endif // BYTE_RANGES_H
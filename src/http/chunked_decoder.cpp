@@ -0,0 +1,209 @@
+#include "chunked_decoder.h"
+
+#include <cstring>
+#include <algorithm>
+
+#include "scanner.h"
+
+using namespace http;
+
+namespace {
+
+int hex_digit(char ch) noexcept
+{
+    if (ch >= '0' && ch <= '9') {
+        return ch - '0';
+    }
+    if (ch >= 'a' && ch <= 'f') {
+        return ch - 'a' + 10;
+    }
+    if (ch >= 'A' && ch <= 'F') {
+        return ch - 'A' + 10;
+    }
+    return -1;
+}
+
+bool is_text(char ch) noexcept
+{
+    return text_table.classes[static_cast<uint8_t>(ch)] == char_class::regular;
+}
+
+}
+
+size_t chunked_decoder::decode(const char *src, size_t size, char *dst, size_t &consumed) noexcept
+{
+    size_t payload_size = 0;
+    size_t i = 0;
+
+    while (i < size && _state != state::done && _state != state::error) {
+        const char ch = src[i];
+
+        switch (_state) {
+        case state::size: {
+            const int digit = hex_digit(ch);
+            if (digit != -1) {
+                if (_chunk_size >= max_chunk_size) {
+                    go_error();
+                    break;
+                }
+                _chunk_size = (_chunk_size << 4) | static_cast<uint64_t>(digit);
+                ++_size_digits;
+            } else if (_size_digits == 0) {
+                go_error();
+                break;
+            } else if (ch == '\r') {
+                _state = state::size_lf;
+            } else if (ch == ';' || ch == ' ' || ch == '\t') {
+                // extensions aren't used, they're only checked
+                _state = state::ext;
+            } else {
+                go_error();
+                break;
+            }
+            ++i;
+            break;
+        }
+
+        case state::ext:
+            if (ch == '\r') {
+                _state = state::size_lf;
+            } else if (!is_text(ch) || ++_ext_size > max_ext_size) {
+                go_error();
+                break;
+            }
+            ++i;
+            break;
+
+        case state::size_lf:
+            if (ch != '\n') {
+                go_error();
+                break;
+            }
+            _state = _chunk_size > 0 ? state::data : state::trailer;
+            ++i;
+            break;
+
+        case state::data: {
+            // the payload is moved by runs, not by bytes
+            const size_t size_left = size - i;
+            const size_t run = static_cast<size_t>(std::min<uint64_t>(_chunk_size, size_left));
+            if (dst + payload_size != src + i) {
+                memmove(dst + payload_size, src + i, run);
+            }
+            payload_size += run;
+            i += run;
+
+            _chunk_size -= run;
+            if (_chunk_size == 0) {
+                _state = state::data_cr;
+            }
+            break;
+        }
+
+        case state::data_cr:
+            if (ch != '\r') {
+                go_error();
+                break;
+            }
+            _state = state::data_lf;
+            ++i;
+            break;
+
+        case state::data_lf:
+            if (ch != '\n') {
+                go_error();
+                break;
+            }
+            _state = state::size;
+            _size_digits = 0;
+            _ext_size = 0;
+            ++i;
+            break;
+
+        case state::trailer:
+            // an empty line ends the body
+            if (ch == '\r') {
+                _state = state::last_lf;
+                ++i;
+            } else {
+                _state = state::trailer_line;
+            }
+            break;
+
+        case state::trailer_line:
+            if (ch == '\r') {
+                _state = state::trailer_lf;
+            } else if (!is_text(ch) || _trailers.size() >= max_trailers_size) {
+                go_error();
+                break;
+            } else {
+                _trailers.push_back(ch);
+            }
+            ++i;
+            break;
+
+        case state::trailer_lf:
+            if (ch != '\n') {
+                go_error();
+                break;
+            }
+            _trailers.append("\r\n");
+            _state = state::trailer;
+            ++i;
+            break;
+
+        case state::last_lf:
+            if (ch != '\n') {
+                go_error();
+                break;
+            }
+            _state = state::done;
+            ++i;
+            break;
+
+        case state::done:
+        case state::error:
+            break;
+        }
+    }
+
+    consumed = i;
+    return payload_size;
+}
+
+chunked_decoder::status chunked_decoder::get_status() const noexcept
+{
+    switch (_state) {
+    case state::done:
+        return status::done;
+    case state::error:
+        return status::error;
+    default:
+        break;
+    }
+    return status::more;
+}
+
+uint64_t chunked_decoder::data_left() const noexcept
+{
+    return _state == state::data ? _chunk_size : 0;
+}
+
+std::string &chunked_decoder::trailers() noexcept
+{
+    return _trailers;
+}
+
+void chunked_decoder::reset() noexcept
+{
+    _state = state::size;
+    _chunk_size = 0;
+    _size_digits = 0;
+    _ext_size = 0;
+    _trailers.clear();
+}
+
+void chunked_decoder::go_error() noexcept
+{
+    _state = state::error;
+}
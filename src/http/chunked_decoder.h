@@ -0,0 +1,68 @@
+#ifndef CHUNKED_DECODER_H
+#define CHUNKED_DECODER_H
+
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+namespace http {
+
+// Incremental decoder of a chunked body. It takes bytes as they're read
+// and keeps its place between reads, so nothing is buffered but trailers.
+class chunked_decoder
+{
+public:
+    enum class status
+    {
+        more,
+        done,
+        error
+    };
+
+    // decodes size bytes of src and moves the payload to dst, dst can be src
+    // or point before it in the same buffer. Returns the payload size,
+    // consumed is less than size if the body ends in the middle of src.
+    size_t decode(const char* src, size_t size, char* dst, size_t& consumed) noexcept;
+
+    status get_status() const noexcept;
+    // payload bytes of the current chunk which aren't read yet
+    uint64_t data_left() const noexcept;
+    // trailer lines, every line ends by CRLF
+    std::string& trailers() noexcept;
+
+    void reset() noexcept;
+
+private:
+    enum class state
+    {
+        size,
+        ext,
+        size_lf,
+        data,
+        data_cr,
+        data_lf,
+        trailer,
+        trailer_line,
+        trailer_lf,
+        last_lf,
+        done,
+        error
+    };
+
+    void go_error() noexcept;
+
+private:
+    const uint64_t max_chunk_size = uint64_t(1) << 48;
+    const size_t max_ext_size = 1024;
+    const size_t max_trailers_size = 8*1024;
+
+    state _state = state::size;
+    uint64_t _chunk_size = 0;
+    size_t _size_digits = 0;
+    size_t _ext_size = 0;
+    std::string _trailers;
+};
+
+}
+
+#endif // CHUNKED_DECODER_H
@@ -7,7 +7,6 @@
 #include <arpa/inet.h>
 #include <netinet/in.h>
 #include <sys/types.h>
-#include <sys/epoll.h>
 #include <sys/socket.h>
 
 #include <cstring>
@@ -17,31 +16,28 @@
 
 using namespace http;
 
-client::client() noexcept
+client::client(io_backend backend) noexcept
 {
-    const size_t epoll_num = 1;
-    _epolls.reserve(epoll_num);
-    for (size_t i=0; i<epoll_num; ++i) {
-        int fd = epoll_create1(0);
-        if (fd != -1) {
-            _epolls.push_back(fd);
+    const size_t workers_num = 1;
+    _workers.reserve(workers_num);
+    for (size_t i=0; i<workers_num; ++i) {
+        client_worker* wrk = new client_worker(backend);
+        if (wrk->start()) {
+            _workers.push_back(wrk);
         } else {
-            // TODO:
-            perror("epoll_create");
-//            return false;
+            delete wrk;
         }
     }
-
-    for (size_t i=0; i<_epolls.size(); ++i) {
-        client_worker* wrk = new client_worker(_epolls.at(i));
-        wrk->start();
-        _workers.push_back(wrk);
-    }
 }
 
 client::~client()
 {
-    // TODO: check release resources and memory
+    // responses which haven't come yet are dropped with their connections
+    for (client_worker* wrk : _workers) {
+        wrk->stop();
+        delete wrk;
+    }
+    _workers.clear();
 }
 
 bool client::send(const request &request,
@@ -50,6 +46,19 @@ bool client::send(const request &request,
                   const std::string &uri,
                   const response_handler &handler)
 {
+    return send(http::request(request), host, port, uri, handler);
+}
+
+bool client::send(request &&request,
+                  const std::string &host,
+                  uint16_t port,
+                  const std::string &uri,
+                  const response_handler &handler)
+{
+    if (_workers.empty()) {
+        return false;
+    }
+
     struct addrinfo* addrs;
 
     struct addrinfo hints;
@@ -97,19 +106,13 @@ bool client::send(const request &request,
     conn->sock_d = sd;
     conn->resp_handler = handler;
     conn->state = connection_state::write_request;
-    conn->req_reader = std::make_unique<request_reader>(request, host, port, uri);
-
-    epoll_event in_event;
-    in_event.events = EPOLLOUT | EPOLLRDHUP;
-    in_event.data.ptr = conn;
+    conn->req_reader = std::make_unique<request_reader>(std::move(request), host, port, uri);
 
-    if (epoll_ctl(_epolls.at(_current_epoll_index), EPOLL_CTL_ADD, sd, &in_event) == -1) {
-        perror("epoll_ctl");
-    }
+    _workers.at(_current_worker_index)->add_connection(conn);
 
-    ++_current_epoll_index;
-    if (_current_epoll_index >= _epolls.size()) {
-        _current_epoll_index = 0;
+    ++_current_worker_index;
+    if (_current_worker_index >= _workers.size()) {
+        _current_worker_index = 0;
     }
 
     return true;
@@ -7,6 +7,7 @@
 
 #include "request.h"
 #include "handlers.h"
+#include "server_config.h"
 
 namespace http {
 
@@ -15,9 +16,15 @@ class client_worker;
 class client
 {
 public:
-    client() noexcept;
+    explicit client(io_backend backend = io_backend::epoll) noexcept;
     ~client();
 
+    // the moved request is written without a copy of its body
+    bool send(request&& request,
+              const std::string& host,
+              uint16_t port,
+              const std::string& uri,
+              const response_handler& handler);
     bool send(const request& request,
               const std::string& host,
               uint16_t port,
@@ -25,8 +32,7 @@ public:
               const response_handler& handler);
 
 private:
-    std::atomic<size_t> _current_epoll_index = 0;
-    std::vector<int> _epolls;
+    std::atomic<size_t> _current_worker_index = 0;
     std::vector<client_worker*> _workers;
 };
 
@@ -2,73 +2,183 @@
 
 #include <cassert>
 
-#include <sys/epoll.h>
-#include <sys/sendfile.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
 #include <glog/logging.h>
 
 #include "connection.h"
+#include "../utility/datetime.h"
 
 using namespace http;
 
-client_worker::client_worker(int epoll_d) noexcept :
-    _epoll_d(epoll_d)
+client_worker::client_worker(io_backend backend) noexcept :
+    _buffers(2*1024, 1024, false)
 {
+    _config.backend = backend;
     _isRuning.store(false);
 }
 
 client_worker::~client_worker()
 {
     stop();
+
+    _reactor.reset();
+    if (_wake_d != -1) {
+        close(_wake_d);
+    }
 }
 
-void client_worker::start() noexcept
+bool client_worker::start() noexcept
 {
-    LOG(INFO) << "Listen " << _epoll_d;
+    _wake_d = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (_wake_d == -1) {
+        perror("eventfd");
+        return false;
+    }
+
+    _reactor = make_reactor(_config, this, -1, _wake_d);
+    if (!_reactor) {
+        return false;
+    }
+
     _isRuning.store(true);
     _thread = std::thread(&client_worker::loop, this);
+
+    return true;
 }
 
 void client_worker::stop() noexcept
 {
-    _isRuning.store(true);
+    _isRuning.store(false);
     if (_thread.joinable()) {
+        // the loop can sleep in wait for a long timeout
+        uint64_t value = 1;
+        if (write(_wake_d, &value, sizeof(value)) == -1) {
+            perror("write eventfd");
+        }
         _thread.join();
     }
 }
 
+void client_worker::add_connection(connection *conn) noexcept
+{
+    {
+        std::lock_guard<std::mutex> lock(_pending_mutex);
+        _pending_conns.push_back(conn);
+    }
+
+    uint64_t value = 1;
+    if (write(_wake_d, &value, sizeof(value)) == -1) {
+        perror("write eventfd");
+    }
+}
+
 void client_worker::loop() noexcept
 {
     const int timeout_msecs = 30000;
-    const size_t max_events = 1000;
-    epoll_event events[max_events];
 
     while (_isRuning) {
-        int num_conns = epoll_wait(_epoll_d, events, max_events, timeout_msecs);
-        for (int i = 0; i < num_conns; ++i) {
-            const epoll_event& event = events[i];
-            connection* conn = reinterpret_cast<connection*>(event.data.ptr);
-            if (event.events&EPOLLIN) {
-                handle_in(conn);
-            } else if (event.events&EPOLLOUT) {
-                handle_out(conn);
-                if (conn->state == connection_state::read_response) {
-                    epoll_event event;
-                    event.events = EPOLLIN | EPOLLRDHUP;
-                    event.data.ptr = conn;
-                    if (epoll_ctl(_epoll_d, EPOLL_CTL_MOD, conn->sock_d, &event) == -1) {
-                        perror("epoll_ctl mod");
-                        go_close_connection(conn);
-                    }
-                }
-            } else if (event.events&EPOLLRDHUP) {
-                go_close_connection(conn);
-            } else {
-                assert(false);
-            }
+        _reactor->wait(timeout_msecs);
+        _reactor->dispatch();
+    }
+
+    close_connections();
+}
+
+void client_worker::close_connections() noexcept
+{
+    {
+        std::lock_guard<std::mutex> lock(_pending_mutex);
+        for (connection* conn : _pending_conns) {
+            close(conn->sock_d);
+            delete conn;
         }
+        _pending_conns.clear();
+    }
+
+    connection* conn = _open_head;
+    while (conn != nullptr) {
+        connection* next = conn->open_next;
+        go_close_connection(conn);
+        conn = next;
+    }
+
+    // io_uring releases a connection when the completions of its operations come
+    const int64_t deadline_msecs = datetime::monotonic_msecs() + 1000;
+    while (_open_head != nullptr && datetime::monotonic_msecs() < deadline_msecs) {
+        _reactor->wait(10);
+        _reactor->dispatch();
     }
 }
 
+void client_worker::handle_accept(int sock_d) noexcept
+{
+    // the client doesn't listen
+    close(sock_d);
+}
+
+void client_worker::handle_wake() noexcept
+{
+    uint64_t value = 0;
+    if (read(_wake_d, &value, sizeof(value)) == -1 && errno != EAGAIN) {
+        perror("read eventfd");
+    }
+
+    std::vector<connection*> conns;
+    {
+        std::lock_guard<std::mutex> lock(_pending_mutex);
+        conns.swap(_pending_conns);
+    }
+
+    for (connection* conn : conns) {
+        if (!_isRuning) {
+            close(conn->sock_d);
+            delete conn;
+            continue;
+        }
+        if (!_reactor->open(conn)) {
+            // TODO: enum error
+            go_close_connection_by_error(conn, 601);
+            continue;
+        }
+
+        conn->open_next = _open_head;
+        if (_open_head != nullptr) {
+            _open_head->open_prev = conn;
+        }
+        _open_head = conn;
+
+        if (conn->writable) {
+            handle_out(conn);
+        }
+    }
+}
+
+void client_worker::handle_event(connection *conn) noexcept
+{
+    if (conn->readable && conn->state == connection_state::read_response) {
+        handle_in(conn);
+    } else if (conn->writable && conn->state == connection_state::write_request) {
+        handle_out(conn);
+    } else if (conn->hangup) {
+        go_close_connection(conn);
+    }
+}
+
+void client_worker::handle_closed(connection *conn) noexcept
+{
+    if (conn->open_prev != nullptr) {
+        conn->open_prev->open_next = conn->open_next;
+    } else if (_open_head == conn) {
+        _open_head = conn->open_next;
+    }
+    if (conn->open_next != nullptr) {
+        conn->open_next->open_prev = conn->open_prev;
+    }
+
+    delete conn;
+}
+
 void client_worker::handle_in(connection *conn) noexcept
 {
     if (conn->state != connection_state::read_response) {
@@ -80,10 +190,11 @@ void client_worker::handle_in(connection *conn) noexcept
     while (resp_state_machine->get_state() == response_state_machine::state::processing) {
         auto [buff, size] = resp_state_machine->prepare_buff();
         if (size > 0) {
-            const ssize_t s_read_size = read(conn->sock_d, buff, size);
+            const ssize_t s_read_size = _reactor->read(conn, buff, size);
             if (s_read_size > 0) {
                 resp_state_machine->process_buff(static_cast<size_t>(s_read_size));
             } else if (s_read_size == -1 && errno == EAGAIN) {
+                conn->readable = false;
                 return;
             } else {
                 // TODO: error enum
@@ -123,9 +234,12 @@ void client_worker::handle_out(connection *conn) noexcept
 
         ssize_t written = -1;
         if (chunk.buff != nullptr) {
-            written = write(conn->sock_d, chunk.buff, chunk.size);
+            iovec iov;
+            iov.iov_base = const_cast<char*>(chunk.buff);
+            iov.iov_len = chunk.size;
+            written = _reactor->send(conn, &iov, 1, false);
         } else if (chunk.file_d != -1) {
-            written = sendfile(conn->sock_d, chunk.file_d, &chunk.file_offset, chunk.size);
+            written = _reactor->sendfile(conn, chunk.file_d, chunk.file_offset, chunk.size);
         } else {
             assert(1);
         }
@@ -133,6 +247,7 @@ void client_worker::handle_out(connection *conn) noexcept
         if (written > 0) {
             req_reader->next(static_cast<size_t>(written));
         } else if (written == -1 && errno == EAGAIN) {
+            conn->writable = false;
             break;
         } else {
             perror("write request");
@@ -144,19 +259,27 @@ void client_worker::handle_out(connection *conn) noexcept
 
     if (!req_reader->has_chunks()) {
         go_read_response(conn);
+        if (!_reactor->watch(conn)) {
+            go_close_connection(conn);
+            return;
+        }
+        // the response can be already received
+        if (conn->readable) {
+            handle_in(conn);
+        }
     }
 }
 
 void client_worker::go_read_response(connection *conn) noexcept
 {
-    conn->resp_state_machine = std::make_unique<response_state_machine>();
+    conn->resp_state_machine = std::make_unique<response_state_machine>(&_buffers);
     conn->state = connection_state::read_response;
 }
 
 void client_worker::go_close_connection(connection *conn) noexcept
 {
-    close(conn->sock_d);
-    delete conn;
+    // the connection is deleted by handle_closed
+    _reactor->close(conn);
 }
 
 void client_worker::go_close_connection_by_error(connection *conn, int err_code) noexcept
@@ -2,24 +2,40 @@
 #define CLIENT_WORKER_H
 
 #include <string>
+#include <vector>
 #include <thread>
 #include <atomic>
+#include <mutex>
+#include <memory>
+
+#include "buffer_pool.h"
+#include "reactor.h"
 
 namespace http {
 
 struct connection;
 
-class client_worker
+class client_worker : public reactor_handler
 {
 public:
-    client_worker(int epoll_d) noexcept;
-    ~client_worker();
+    explicit client_worker(io_backend backend) noexcept;
+    ~client_worker() override;
 
-    void start() noexcept;
+    bool start() noexcept;
     void stop() noexcept;
 
+    // hands a connected socket over to the worker thread
+    void add_connection(connection* conn) noexcept;
+
 private:
     void loop() noexcept;
+    // closes the open and pending connections when the loop ends
+    void close_connections() noexcept;
+
+    void handle_accept(int sock_d) noexcept override;
+    void handle_wake() noexcept override;
+    void handle_event(connection* conn) noexcept override;
+    void handle_closed(connection* conn) noexcept override;
 
     void handle_in(connection* conn) noexcept;
     void handle_out(connection* conn) noexcept;
@@ -29,9 +45,19 @@ private:
     void go_close_connection_by_error(connection* conn, int err_code) noexcept;
 
 private:
-    int _epoll_d = -1;
+    server_config _config;
+    std::unique_ptr<reactor> _reactor;
+    int _wake_d = -1;
     std::atomic<bool> _isRuning;
     std::thread _thread;
+
+    std::mutex _pending_mutex;
+    std::vector<connection*> _pending_conns;
+
+    // connections opened in the reactor
+    connection* _open_head = nullptr;
+
+    buffer_pool _buffers;
 };
 
 }
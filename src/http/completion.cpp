@@ -0,0 +1,166 @@
+#include "completion.h"
+
+#include <cstdio>
+#include <cstdint>
+
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+using namespace http;
+
+namespace {
+
+thread_local connection_handle* current_handle = nullptr;
+
+// the head of a closed mailbox
+completion closed_mark;
+completion* const closed = &closed_mark;
+
+void delete_items(completion* item) noexcept
+{
+    while (item != nullptr && item != closed) {
+        completion* next = item->next;
+        delete item;
+        item = next;
+    }
+}
+
+}
+
+completion_mailbox::~completion_mailbox()
+{
+    delete_items(_head.exchange(nullptr));
+
+    if (_wake_d != -1) {
+        ::close(_wake_d);
+    }
+}
+
+bool completion_mailbox::init() noexcept
+{
+    _wake_d = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (_wake_d == -1) {
+        perror("eventfd");
+        return false;
+    }
+    return true;
+}
+
+int completion_mailbox::wake_d() const noexcept
+{
+    return _wake_d;
+}
+
+void completion_mailbox::wake() noexcept
+{
+    uint64_t value = 1;
+    if (write(_wake_d, &value, sizeof(value)) == -1) {
+        perror("write eventfd");
+    }
+}
+
+void completion_mailbox::post(completion *item) noexcept
+{
+    completion* head = _head.load(std::memory_order_relaxed);
+    do {
+        if (head == closed) {
+            delete item;
+            return;
+        }
+        item->next = head;
+    } while (!_head.compare_exchange_weak(head, item,
+                                          std::memory_order_release,
+                                          std::memory_order_relaxed));
+
+    // the worker is woken once till it takes the items
+    if (head == nullptr) {
+        wake();
+    }
+}
+
+completion *completion_mailbox::take() noexcept
+{
+    completion* item = _head.load(std::memory_order_relaxed);
+    do {
+        if (item == closed) {
+            return nullptr;
+        }
+    } while (!_head.compare_exchange_weak(item, nullptr,
+                                          std::memory_order_acquire,
+                                          std::memory_order_relaxed));
+
+    // the items are pushed in the reverse order
+    completion* items = nullptr;
+    while (item != nullptr) {
+        completion* next = item->next;
+        item->next = items;
+        items = item;
+        item = next;
+    }
+    return items;
+}
+
+void completion_mailbox::close() noexcept
+{
+    delete_items(_head.exchange(closed, std::memory_order_acquire));
+}
+
+completion_scope::completion_scope(connection_handle *handle) noexcept :
+    _prev(current_handle)
+{
+    current_handle = handle;
+}
+
+completion_scope::~completion_scope()
+{
+    current_handle = _prev;
+}
+
+completion_token::completion_token(std::shared_ptr<connection_handle> handle) noexcept :
+    _handle(std::move(handle))
+{
+}
+
+void completion_token::complete(response &&resp) const noexcept
+{
+    if (_handle->completed.exchange(true) || _handle->cancelled.load()) {
+        return;
+    }
+
+    if (current_handle == _handle.get()) {
+        _handle->completed_inline = true;
+        _handle->inline_resp = std::move(resp);
+        return;
+    }
+
+    _handle->mailbox->post(new completion{_handle, std::move(resp)});
+}
+
+void completion_token::complete(const response &resp) const noexcept
+{
+    complete(response(resp));
+}
+
+bool completion_token::cancelled() const noexcept
+{
+    return _handle->cancelled.load();
+}
+
+body_token::body_token(std::shared_ptr<connection_handle> handle) noexcept :
+    _handle(std::move(handle))
+{
+}
+
+void body_token::resume() const noexcept
+{
+    if (!_handle || _handle->cancelled.load()) {
+        return;
+    }
+
+    _handle->mailbox->post(new completion{_handle, response()});
+}
+
+bool body_token::cancelled() const noexcept
+{
+    return !_handle || _handle->cancelled.load();
+}
@@ -0,0 +1,121 @@
+#ifndef COMPLETION_H
+#define COMPLETION_H
+
+#include <atomic>
+#include <memory>
+
+#include "response.h"
+
+namespace http {
+
+struct connection;
+class completion_mailbox;
+
+// Links an async request to its connection. conn is used only by the worker
+// thread, it's reset when the connection is closed or the handler times out.
+struct connection_handle
+{
+    std::shared_ptr<completion_mailbox> mailbox;
+    connection* conn = nullptr;
+
+    std::atomic<bool> cancelled{false};
+    std::atomic<bool> completed{false};
+    // the response comes from the compressor, so it isn't encoded again
+    bool encoded = false;
+    // the handle resumes a body paused by the body handler, its items have no response
+    bool body = false;
+
+    // the response given while the worker thread was still in the handler
+    bool completed_inline = false;
+    response inline_resp;
+};
+
+struct completion
+{
+    std::shared_ptr<connection_handle> handle;
+    response resp;
+    completion* next = nullptr;
+};
+
+// Responses of async handlers posted to a worker from other threads.
+// Posting is a lock-free push, the worker takes all the items at once
+// and is woken by the eventfd of the mailbox.
+class completion_mailbox
+{
+public:
+    completion_mailbox() noexcept = default;
+    // the eventfd lives while any handle can post
+    ~completion_mailbox();
+
+    completion_mailbox(const completion_mailbox&) = delete;
+    completion_mailbox& operator=(const completion_mailbox&) = delete;
+
+    bool init() noexcept;
+    int wake_d() const noexcept;
+    void wake() noexcept;
+
+    // the item is deleted if the mailbox is closed
+    void post(completion* item) noexcept;
+    // returns the items in the order of posting, the caller deletes them
+    completion* take() noexcept;
+    // called when the worker stops, the items are deleted, so they don't keep
+    // their handles and through them the mailbox alive
+    void close() noexcept;
+
+private:
+    std::atomic<completion*> _head{nullptr};
+    int _wake_d = -1;
+};
+
+// Set by the worker thread while it calls an async handler,
+// so a response given right away doesn't go through the mailbox.
+class completion_scope
+{
+public:
+    explicit completion_scope(connection_handle* handle) noexcept;
+    ~completion_scope();
+
+    completion_scope(const completion_scope&) = delete;
+    completion_scope& operator=(const completion_scope&) = delete;
+
+private:
+    connection_handle* _prev = nullptr;
+};
+
+// Given to an async request handler, it can be completed from any thread.
+class completion_token
+{
+public:
+    explicit completion_token(std::shared_ptr<connection_handle> handle) noexcept;
+
+    // hands the response to the worker of the connection, only the first call counts
+    void complete(response&& resp) const noexcept;
+    // copies the response, the body included
+    void complete(const response& resp) const noexcept;
+    // the client has gone or the handler has timed out, so a response won't be sent
+    bool cancelled() const noexcept;
+
+private:
+    std::shared_ptr<connection_handle> _handle;
+};
+
+// Given to a body handler, it resumes reading of the body paused
+// by the handler from any thread.
+class body_token
+{
+public:
+    body_token() noexcept = default;
+    explicit body_token(std::shared_ptr<connection_handle> handle) noexcept;
+
+    // the worker reads the body again, it's called once for each pause
+    void resume() const noexcept;
+    // the connection is closed, so the body won't be read
+    bool cancelled() const noexcept;
+
+private:
+    std::shared_ptr<connection_handle> _handle;
+};
+
+}
+
+#endif // COMPLETION_H
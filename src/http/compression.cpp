@@ -0,0 +1,474 @@
+#include "compression.h"
+
+#include <cstring>
+#include <algorithm>
+#include <functional>
+
+#include <zlib.h>
+#ifdef HAVE_BROTLI
+#include <brotli/encode.h>
+#endif
+
+#include "conditional.h"
+
+using namespace http;
+
+namespace {
+
+const size_t encodings_num = 4;
+
+// weights in thousandths, -1 if the encoding isn't mentioned
+struct accept_weights
+{
+    int values[encodings_num] = {-1, -1, -1, -1};
+    int any = -1;
+
+    int get(content_encoding encoding) const noexcept
+    {
+        const int value = values[static_cast<size_t>(encoding)];
+        if (value != -1) {
+            return value;
+        }
+        return any != -1 ? any : 0;
+    }
+};
+
+int parse_weight(const char* pos, const char* end) noexcept
+{
+    // q=0, q=0.5, q=1.000
+    while (pos < end && (*pos == ' ' || *pos == '\t')) {
+        ++pos;
+    }
+    if (end - pos < 3 || (pos[0] != 'q' && pos[0] != 'Q') || pos[1] != '=') {
+        return 1000;
+    }
+    pos += 2;
+
+    int weight = 0;
+    if (*pos == '1') {
+        return 1000;
+    } else if (*pos != '0') {
+        return 0;
+    }
+    ++pos;
+    if (pos < end && *pos == '.') {
+        ++pos;
+        int scale = 100;
+        while (pos < end && *pos >= '0' && *pos <= '9' && scale > 0) {
+            weight += (*pos - '0') * scale;
+            scale /= 10;
+            ++pos;
+        }
+    }
+    return weight;
+}
+
+accept_weights parse_accept_encoding(string value) noexcept
+{
+    accept_weights res;
+
+    const char* pos = value.data();
+    const char* end = value.data() + value.size();
+    while (pos < end) {
+        while (pos < end && (*pos == ' ' || *pos == '\t' || *pos == ',')) {
+            ++pos;
+        }
+        const char* item_end = std::find(pos, end, ',');
+
+        const char* name_end = pos;
+        while (name_end < item_end && *name_end != ';' && *name_end != ' ' && *name_end != '\t') {
+            ++name_end;
+        }
+        const char* params = std::find(name_end, item_end, ';');
+        const int weight = params != item_end ? parse_weight(params + 1, item_end) : 1000;
+
+        const string name(pos, static_cast<size_t>(name_end - pos));
+        if (name.compare_nocase("br") == 0) {
+            res.values[static_cast<size_t>(content_encoding::br)] = weight;
+        } else if (name.compare_nocase("gzip") == 0 || name.compare_nocase("x-gzip") == 0) {
+            res.values[static_cast<size_t>(content_encoding::gzip)] = weight;
+        } else if (name.compare_nocase("deflate") == 0) {
+            res.values[static_cast<size_t>(content_encoding::deflate)] = weight;
+        } else if (name.compare("*") == 0) {
+            res.any = weight;
+        }
+
+        pos = item_end;
+    }
+    return res;
+}
+
+buffer compress_zlib(const char* data, size_t size, content_encoding encoding, int level) noexcept
+{
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+
+    // gzip has its own header, deflate is the zlib format
+    const int window_bits = encoding == content_encoding::gzip ? 15 + 16 : 15;
+    if (deflateInit2(&stream, std::clamp(level, 1, 9), Z_DEFLATED, window_bits, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return buffer();
+    }
+
+    const size_t bound = deflateBound(&stream, static_cast<uLong>(size));
+    std::unique_ptr<char[]> out(new char[bound]);
+
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+    stream.avail_in = static_cast<uInt>(size);
+    stream.next_out = reinterpret_cast<Bytef*>(out.get());
+    stream.avail_out = static_cast<uInt>(bound);
+
+    const int res = deflate(&stream, Z_FINISH);
+    const size_t out_size = stream.total_out;
+    deflateEnd(&stream);
+
+    if (res != Z_STREAM_END || out_size >= size) {
+        return buffer();
+    }
+    return buffer(out.release(), out_size);
+}
+
+#ifdef HAVE_BROTLI
+buffer compress_brotli(const char* data, size_t size, int level) noexcept
+{
+    size_t out_size = BrotliEncoderMaxCompressedSize(size);
+    if (out_size == 0) {
+        return buffer();
+    }
+    std::unique_ptr<char[]> out(new char[out_size]);
+
+    if (!BrotliEncoderCompress(std::clamp(level, BROTLI_MIN_QUALITY, BROTLI_MAX_QUALITY),
+                               BROTLI_DEFAULT_WINDOW, BROTLI_MODE_TEXT,
+                               size, reinterpret_cast<const uint8_t*>(data),
+                               &out_size, reinterpret_cast<uint8_t*>(out.get()))
+            || out_size >= size) {
+        return buffer();
+    }
+    return buffer(out.release(), out_size);
+}
+#endif
+
+// the tag of an encoded body differs from the identity one
+std::string encoded_etag(const std::string& etag, content_encoding encoding)
+{
+    if (etag.size() < 2 || etag.back() != '"') {
+        return etag;
+    }
+
+    std::string res(etag, 0, etag.size() - 1);
+    res.push_back('-');
+    res.append(content_encoding_to_str(encoding));
+    res.push_back('"');
+    return res;
+}
+
+}
+
+content_encoding http::select_content_encoding(string accept_encoding, bool precompressed) noexcept
+{
+    const accept_weights weights = parse_accept_encoding(accept_encoding);
+
+    content_encoding res = content_encoding::identity;
+    int best = 0;
+    for (content_encoding encoding : {content_encoding::br, content_encoding::gzip, content_encoding::deflate}) {
+#ifndef HAVE_BROTLI
+        if (encoding == content_encoding::br && !precompressed) {
+            continue;
+        }
+#endif
+        if (encoding == content_encoding::deflate && precompressed) {
+            continue;
+        }
+
+        const int weight = weights.get(encoding);
+        if (weight > best) {
+            best = weight;
+            res = encoding;
+        }
+    }
+    return res;
+}
+
+buffer http::compress(const char *data, size_t size, content_encoding encoding, int level) noexcept
+{
+    switch (encoding) {
+    case content_encoding::gzip:
+    case content_encoding::deflate:
+        return compress_zlib(data, size, encoding, level);
+    case content_encoding::br:
+#ifdef HAVE_BROTLI
+        return compress_brotli(data, size, level);
+#else
+        return buffer();
+#endif
+    case content_encoding::identity:
+        break;
+    }
+    return buffer();
+}
+
+compressor::compressor(file_cache &files, executor &exec) noexcept :
+    _files(files),
+    _executor(exec)
+{
+}
+
+void compressor::set_config(const compression_config &config) noexcept
+{
+    _config = config;
+}
+
+compressor::result compressor::encode(const request *req,
+                                      response &resp,
+                                      response &encoded,
+                                      content_encoding &encoding) noexcept
+{
+    if (!_config.enabled || req == nullptr || req->method != request_method::get || resp.code != 200
+            || resp.producer || !resp.body_chain.empty() || resp.encoding != content_encoding::identity
+            || !content_type_compressible(resp.content_type)) {
+        return result::as_is;
+    }
+
+    const bool file = resp.body_file || !resp.body_file_path.empty();
+    if (!file && body_of(resp).size() < _config.min_size) {
+        return result::as_is;
+    }
+    // the body can be encoded for another Accept-Encoding
+    resp.vary_encoding = true;
+
+    string accept_encoding;
+    if (!req->header_fields.get(known_header::accept_encoding, accept_encoding)) {
+        return result::as_is;
+    }
+
+    // ranges are taken of the identity body
+    string range;
+    if (req->header_fields.get(known_header::range, range)) {
+        return result::as_is;
+    }
+
+    // a body which is sent as 304 isn't compressed
+    if ((!resp.etag.empty() || !resp.last_modified.empty())
+            && not_modified(*req,
+                            string(resp.etag.data(), resp.etag.size()),
+                            string(resp.last_modified.data(), resp.last_modified.size()))) {
+        return result::as_is;
+    }
+
+    if (file) {
+        return encode_file(*req, resp, accept_encoding, encoded);
+    }
+    return encode_body(*req, resp, accept_encoding, encoded, encoding);
+}
+
+void compressor::encode_later(const request &req,
+                              response &&resp,
+                              content_encoding encoding,
+                              completion_token token) noexcept
+{
+    auto original = std::make_shared<response>(std::move(resp));
+    // the body view of the id points into the shared response
+    auto id = std::make_shared<body_id>(make_body_id(req, *original, encoding));
+    _executor.post([this, original, id, encoding, token]() {
+        if (token.cancelled()) {
+            return;
+        }
+
+        buffer body = compress_cached(*id, *original);
+        if (body.empty()) {
+            // the body doesn't shrink, the cache keeps it from being compressed again
+            token.complete(std::move(*original));
+            return;
+        }
+
+        response encoded;
+        make_encoded(*original, body, encoding, encoded);
+        token.complete(std::move(encoded));
+    });
+}
+
+compressor::result compressor::encode_file(const request &req,
+                                           const response &resp,
+                                           string accept_encoding,
+                                           response &encoded) noexcept
+{
+    std::shared_ptr<const file_entry> file = resp.body_file ? resp.body_file : _files.open(resp.body_file_path);
+    if (!file) {
+        return result::as_is;
+    }
+    if (resp.etag.empty() && resp.last_modified.empty()
+            && not_modified(req, string(file->etag.data(), file->etag.size()), string(), file->mtime.tv_sec)) {
+        return result::as_is;
+    }
+
+    const accept_weights weights = parse_accept_encoding(accept_encoding);
+    content_encoding candidates[] = {content_encoding::br, content_encoding::gzip};
+    if (weights.get(content_encoding::gzip) > weights.get(content_encoding::br)) {
+        std::swap(candidates[0], candidates[1]);
+    }
+
+    for (content_encoding encoding : candidates) {
+        if (weights.get(encoding) == 0) {
+            continue;
+        }
+
+        std::string path = file->path;
+        path.append(encoding == content_encoding::br ? ".br" : ".gz");
+        // most files have no siblings, so the misses are remembered
+        std::shared_ptr<const file_entry> sibling = _files.open(path, true);
+        if (!sibling) {
+            continue;
+        }
+
+        // the sibling has its own validators
+        encoded.code = resp.code;
+        encoded.content_type = resp.content_type;
+        encoded.body_file = sibling;
+        encoded.encoding = encoding;
+        return result::encoded;
+    }
+    return result::as_is;
+}
+
+compressor::result compressor::encode_body(const request &req,
+                                           const response &resp,
+                                           string accept_encoding,
+                                           response &encoded,
+                                           content_encoding &encoding) noexcept
+{
+    const std::string_view body = body_of(resp);
+    encoding = select_content_encoding(accept_encoding, false);
+    if (encoding == content_encoding::identity) {
+        return result::as_is;
+    }
+
+    const body_id id = make_body_id(req, resp, encoding);
+    buffer compressed;
+    if (!find(id, compressed)) {
+        if (body.size() >= _config.offload_size) {
+            return result::offload;
+        }
+        compressed = compress_cached(id, resp);
+    }
+
+    if (compressed.empty()) {
+        return result::as_is;
+    }
+
+    make_encoded(resp, compressed, encoding, encoded);
+    return result::encoded;
+}
+
+compressor::body_id compressor::make_body_id(const request &req,
+                                            const response &resp,
+                                            content_encoding encoding)
+{
+    body_id res;
+    res.body = body_of(resp);
+    res.key.size = res.body.size();
+    res.key.encoding = encoding;
+
+    // a tag is unique only within its resource
+    if (!resp.etag.empty()) {
+        res.tag.reserve(req.uri.size() + resp.etag.size() + 1);
+        res.tag.append(req.uri);
+        res.tag.push_back(' ');
+        res.tag.append(resp.etag);
+        res.key.hash = std::hash<std::string>()(res.tag);
+    } else {
+        res.key.hash = std::hash<std::string_view>()(res.body);
+    }
+    return res;
+}
+
+buffer compressor::compress_cached(const body_id &id, const response &resp) noexcept
+{
+    buffer res;
+    if (find(id, res)) {
+        return res;
+    }
+
+    res = compress(id.body.data(), id.body.size(), id.key.encoding, _config.level);
+    insert(id, resp, res);
+    return res;
+}
+
+bool compressor::find(const body_id &id, buffer &body) noexcept
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto it = _entries.find(id.key);
+    if (it == _entries.end()) {
+        return false;
+    }
+
+    // the sizes are equal by the key
+    const cache_entry& entry = *it->second;
+    if (entry.tag != id.tag) {
+        return false;
+    }
+    if (id.tag.empty() && !id.body.empty() && memcmp(entry.original.data(), id.body.data(), id.body.size()) != 0) {
+        return false;
+    }
+
+    _lru.splice(_lru.begin(), _lru, it->second);
+    body = entry.body;
+    return true;
+}
+
+void compressor::insert(const body_id &id, const response &resp, const buffer &body) noexcept
+{
+    const size_t entry_overhead = 64;
+    const size_t size = id.tag.size() + body.size() + entry_overhead;
+
+    // one big body doesn't wipe the cache out
+    if (size > _config.cache_size / 8) {
+        return;
+    }
+
+    // a buffer body is shared, a string one is copied
+    buffer original;
+    if (id.tag.empty()) {
+        original = !resp.body_buff.empty() && resp.body_str.empty()
+                ? resp.body_buff
+                : buffer::copy(id.body.data(), id.body.size());
+    }
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_entries.count(id.key) != 0) {
+        return;
+    }
+
+    while (!_lru.empty() && _cached_size + size > _config.cache_size) {
+        const cache_entry& last = _lru.back();
+        _cached_size -= last.tag.size() + last.body.size() + entry_overhead;
+        _entries.erase(last.key);
+        _lru.pop_back();
+    }
+
+    _lru.push_front({id.key, id.tag, std::move(original), body});
+    _entries.emplace(id.key, _lru.begin());
+    _cached_size += size;
+}
+
+std::string_view compressor::body_of(const response &resp) noexcept
+{
+    if (!resp.body_str.empty()) {
+        return resp.body_str;
+    }
+    if (!resp.body_buff.empty()) {
+        return std::string_view(resp.body_buff.data(), resp.body_buff.size());
+    }
+    return std::string_view();
+}
+
+void compressor::make_encoded(const response &resp,
+                              buffer body,
+                              content_encoding encoding,
+                              response &encoded)
+{
+    encoded.code = resp.code;
+    encoded.content_type = resp.content_type;
+    encoded.body_buff = std::move(body);
+    encoded.etag = encoded_etag(resp.etag, encoding);
+    encoded.last_modified = resp.last_modified;
+    encoded.encoding = encoding;
+}
@@ -0,0 +1,147 @@
+#ifndef COMPRESSION_H
+#define COMPRESSION_H
+
+#include <list>
+#include <mutex>
+#include <memory>
+#include <cstdint>
+#include <string_view>
+#include <unordered_map>
+
+#include "str.h"
+#include "buffer.h"
+#include "request.h"
+#include "response.h"
+#include "file_cache.h"
+#include "executor.h"
+#include "completion.h"
+#include "content_types.h"
+
+namespace http {
+
+// the best encoding the Accept-Encoding value allows, brotli goes first on equal weights,
+// a precompressed file can only be brotli or gzip
+content_encoding select_content_encoding(string accept_encoding, bool precompressed) noexcept;
+
+// returns an empty buffer if the encoding fails or doesn't make the body smaller
+buffer compress(const char* data, size_t size, content_encoding encoding, int level) noexcept;
+
+struct compression_config
+{
+    bool enabled = true;
+    size_t min_size = 1024;
+    size_t offload_size = 64*1024;
+    size_t cache_size = 16*1024*1024;
+    // zlib levels, brotli uses the same number as its quality
+    int level = 6;
+};
+
+// The compression stage of the response path. Files are replaced by their
+// precompressed .br/.gz siblings, string and buffer bodies are compressed on the fly
+// and kept in an LRU. A body with an ETag is told apart by the request target
+// and the tag, other bodies by their hash and a hit is compared with the original.
+// Big bodies are compressed on the executor. It's shared by all workers.
+class compressor
+{
+public:
+    enum class result
+    {
+        as_is,
+        encoded,
+        // the body is compressed by encode_later()
+        offload
+    };
+
+    compressor(file_cache& files, executor& exec) noexcept;
+
+    compressor(const compressor&) = delete;
+    compressor& operator=(const compressor&) = delete;
+
+    // called before the workers start, the config is read without locks
+    void set_config(const compression_config& config) noexcept;
+
+    // encoding is set for offload, resp gets vary_encoding
+    // if it could be encoded for another request
+    result encode(const request* req,
+                  response& resp,
+                  response& encoded,
+                  content_encoding& encoding) noexcept;
+    // compresses the body on the executor and completes the token by the encoded response
+    void encode_later(const request& req,
+                      response&& resp,
+                      content_encoding encoding,
+                      completion_token token) noexcept;
+
+private:
+    struct cache_key
+    {
+        uint64_t hash = 0;
+        size_t size = 0;
+        content_encoding encoding = content_encoding::identity;
+
+        bool operator==(const cache_key& other) const noexcept
+        {
+            return hash == other.hash && size == other.size && encoding == other.encoding;
+        }
+    };
+
+    struct cache_key_hash
+    {
+        size_t operator()(const cache_key& key) const noexcept
+        {
+            return static_cast<size_t>(key.hash ^ (key.size << 3) ^ static_cast<size_t>(key.encoding));
+        }
+    };
+
+    // what a body is told apart by in the cache
+    struct body_id
+    {
+        cache_key key;
+        // the request target and the ETag, empty if the response has no tag
+        std::string tag;
+        // compared on a hit if there is no tag, the hash can collide
+        std::string_view body;
+    };
+
+    struct cache_entry
+    {
+        cache_key key;
+        std::string tag;
+        // kept only if there is no tag, it isn't counted in the cache size
+        buffer original;
+        // empty if the body doesn't shrink
+        buffer body;
+    };
+
+    typedef std::list<cache_entry> lru_list;
+
+    result encode_file(const request& req, const response& resp,
+                       string accept_encoding, response& encoded) noexcept;
+    result encode_body(const request& req, const response& resp, string accept_encoding,
+                       response& encoded, content_encoding& encoding) noexcept;
+
+    static body_id make_body_id(const request& req, const response& resp, content_encoding encoding);
+    buffer compress_cached(const body_id& id, const response& resp) noexcept;
+    bool find(const body_id& id, buffer& body) noexcept;
+    void insert(const body_id& id, const response& resp, const buffer& body) noexcept;
+
+    static std::string_view body_of(const response& resp) noexcept;
+    static void make_encoded(const response& resp,
+                             buffer body,
+                             content_encoding encoding,
+                             response& encoded);
+
+private:
+    file_cache& _files;
+    executor& _executor;
+    compression_config _config;
+
+    std::mutex _mutex;
+    lru_list _lru;
+    std::unordered_map<cache_key, lru_list::iterator, cache_key_hash> _entries;
+    size_t _cached_size = 0;
+};
+
+}
+
+#endif // COMPRESSION_H
@@ -0,0 +1,160 @@
+#include "conditional.h"
+
+#include <cstring>
+#include <string_view>
+
+#include "http_date.h"
+
+using namespace http;
+
+namespace {
+
+// a tag equals etag or it's etag of an encoded body, e.g. "abc-gzip" for "abc"
+bool same_tag(const char* tag, size_t size, string etag) noexcept
+{
+    if (size == etag.size()) {
+        return memcmp(tag, etag.data(), size) == 0;
+    }
+
+    const size_t prefix_size = etag.size() - 1;
+    if (etag.size() < 2 || etag.data()[prefix_size] != '"' || size < etag.size() + 2
+            || tag[size - 1] != '"' || tag[prefix_size] != '-'
+            || memcmp(tag, etag.data(), prefix_size) != 0) {
+        return false;
+    }
+
+    const std::string_view suffix(tag + prefix_size + 1, size - prefix_size - 2);
+    for (content_encoding encoding : {content_encoding::gzip, content_encoding::deflate, content_encoding::br}) {
+        if (suffix == content_encoding_to_str(encoding)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// weak comparison: W/ is ignored, * matches any tag
+bool etag_matches(string list, string etag) noexcept
+{
+    if (etag.size() > 2 && etag.data()[0] == 'W' && etag.data()[1] == '/') {
+        etag = string(etag.data() + 2, etag.size() - 2);
+    }
+
+    const char* pos = list.data();
+    const char* end = list.data() + list.size();
+    while (pos < end) {
+        while (pos < end && (*pos == ' ' || *pos == '\t' || *pos == ',')) {
+            ++pos;
+        }
+        if (pos == end) {
+            break;
+        }
+
+        if (*pos == '*') {
+            return true;
+        }
+        if (end - pos > 2 && pos[0] == 'W' && pos[1] == '/') {
+            pos += 2;
+        }
+
+        // a tag is quoted, so a comma inside it doesn't split the list
+        const char* tag_end = pos;
+        if (tag_end < end && *tag_end == '"') {
+            ++tag_end;
+            while (tag_end < end && *tag_end != '"') {
+                ++tag_end;
+            }
+            if (tag_end < end) {
+                ++tag_end;
+            }
+        } else {
+            while (tag_end < end && *tag_end != ',' && *tag_end != ' ') {
+                ++tag_end;
+            }
+        }
+
+        if (same_tag(pos, static_cast<size_t>(tag_end - pos), etag)) {
+            return true;
+        }
+        pos = tag_end;
+    }
+    return false;
+}
+
+response not_modified_response(validators&& current)
+{
+    response resp;
+    resp.code = 304;
+    resp.etag = std::move(current.etag);
+    resp.last_modified = std::move(current.last_modified);
+    return resp;
+}
+
+void add_validators(response& resp, validators& current)
+{
+    if (resp.code != 200 || !resp.etag.empty() || !resp.last_modified.empty()) {
+        return;
+    }
+    resp.etag = std::move(current.etag);
+    resp.last_modified = std::move(current.last_modified);
+}
+
+}
+
+bool http::not_modified(const request &req, string etag, string last_modified, time_t modified_time) noexcept
+{
+    if (req.method != request_method::get && req.method != request_method::head) {
+        return false;
+    }
+
+    // If-Modified-Since is ignored when If-None-Match is given
+    string if_none_match;
+    if (req.header_fields.get(known_header::if_none_match, if_none_match)) {
+        return !etag.empty() && etag_matches(if_none_match, etag);
+    }
+
+    string if_modified_since;
+    if (!req.header_fields.get(known_header::if_modified_since, if_modified_since)) {
+        return false;
+    }
+
+    if (modified_time == -1 && (last_modified.empty() || !parse_http_date(last_modified, modified_time))) {
+        return false;
+    }
+
+    time_t since = 0;
+    return parse_http_date(if_modified_since, since) && modified_time <= since;
+}
+
+request_handler http::conditional(validator_handler validator, request_handler handl)
+{
+    return [validator, handl](std::shared_ptr<request> req) -> response {
+        validators current;
+        if (!validator(req, current)) {
+            return handl(req);
+        }
+
+        if (not_modified(*req, string(current.etag.data(), current.etag.size()),
+                         string(current.last_modified.data(), current.last_modified.size()))) {
+            return not_modified_response(std::move(current));
+        }
+
+        response resp = handl(req);
+        add_validators(resp, current);
+        return resp;
+    };
+}
+
+async_request_handler http::conditional(validator_handler validator, async_request_handler handl)
+{
+    return [validator, handl](std::shared_ptr<request> req, completion_token token) {
+        validators current;
+        if (validator(req, current)
+                && not_modified(*req, string(current.etag.data(), current.etag.size()),
+                                string(current.last_modified.data(), current.last_modified.size()))) {
+            // completed on the worker thread, so it doesn't go through the mailbox
+            token.complete(not_modified_response(std::move(current)));
+            return;
+        }
+        handl(req, token);
+    };
+}
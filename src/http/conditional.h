@@ -0,0 +1,43 @@
+#ifndef CONDITIONAL_H
+#define CONDITIONAL_H
+
+#include <ctime>
+#include <string>
+#include <memory>
+#include <functional>
+
+#include "str.h"
+#include "request.h"
+#include "response.h"
+#include "handlers.h"
+
+namespace http {
+
+struct validators
+{
+    // a quoted strong tag
+    std::string etag;
+    std::string last_modified;
+};
+
+// gives the current validators of a resource without making its body,
+// e.g. from a version counter, returns false if they aren't known
+typedef std::function<bool(const std::shared_ptr<request>&, validators&)> validator_handler;
+
+// If-None-Match and then If-Modified-Since of a GET or HEAD request against validators,
+// modified_time is -1 if it has to be parsed from last_modified,
+// a tag of an encoded body like "abc-gzip" matches its identity tag "abc"
+bool not_modified(const request& req,
+                  string etag,
+                  string last_modified,
+                  time_t modified_time = -1) noexcept;
+
+// 304 is sent before the handler runs if the validators match the request,
+// otherwise the response gets the validators unless it sets its own,
+// an async handler sets them itself
+request_handler conditional(validator_handler validator, request_handler handl);
+async_request_handler conditional(validator_handler validator, async_request_handler handl);
+
+}
+
+#endif // CONDITIONAL_H
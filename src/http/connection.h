@@ -2,6 +2,9 @@
 #define CONNECTION_H
 
 #include <memory>
+#include <cstdint>
+
+#include <sys/socket.h>
 
 #include "request.h"
 #include "response.h"
@@ -9,25 +12,104 @@
 #include "request_reader.h"
 #include "request_state_machine.h"
 #include "response_state_machine.h"
+#include "timer_wheel.h"
+#include "object_pool.h"
+#include "completion.h"
 
 namespace http {
 
+// the header and in-memory body parts written by one call
+const size_t send_iovecs_num = 8;
+
 enum class connection_state
 {
     read_request,
     write_response,
+    // the body producer of the response has no data yet
+    wait_response,
+    // the async request handler hasn't completed yet
+    wait_handler,
+    // the body handler has paused reading of the body
+    wait_body,
     read_response,
     write_request
 };
 
+enum class connection_timer
+{
+    none,
+    header,
+    body,
+    idle,
+    write,
+    produce,
+    handler
+};
+
+// the state of a connection in the io_uring reactor
+struct uring_state
+{
+    // received buffers linked by buffer ids
+    int32_t recv_head = -1;
+    int32_t recv_tail = -1;
+    size_t recv_offset = 0;
+    // multishot receive is submitted
+    bool recv_armed = false;
+    bool recv_eof = false;
+    int recv_error = 0;
+    // receive stopped because the buffer ring was empty
+    bool starved = false;
+
+    // one send is in flight at a time
+    bool send_inflight = false;
+    bool send_done = false;
+    int send_result = 0;
+    msghdr send_msg = {};
+    iovec send_iov[send_iovecs_num] = {};
+    char* file_buff = nullptr;
+
+    // submitted operations which completions are still to come
+    size_t ops = 0;
+    bool closing = false;
+};
+
 struct connection
 {
     int sock_d = 0;
     connection_state state = connection_state::read_request;
+    // registered epoll events
+    uint32_t events = 0;
+
+    size_t requests_num = 0;
+    bool keep_alive = false;
+
+    timer_node timer;
+    connection_timer timer_kind = connection_timer::none;
+
+    // the socket can be read or written without EAGAIN
+    bool readable = false;
+    bool writable = false;
+    // the peer has closed its side
+    bool hangup = false;
+
+    // the queue of connections with a spent budget
+    bool queued = false;
+    connection* queue_prev = nullptr;
+    connection* queue_next = nullptr;
+
+    // the open connections of a worker, they're closed when it stops
+    connection* open_prev = nullptr;
+    connection* open_next = nullptr;
+
+    uring_state uring;
 
-    std::unique_ptr<request_state_machine> req_state_machine;
+    pooled_ptr<request_state_machine> req_state_machine;
     request_handler req_handler = nullptr;
-    std::unique_ptr<response_reader> resp_reader;
+    // the pending async request
+    std::shared_ptr<connection_handle> handle;
+    // resumes a body paused by the body handler
+    std::shared_ptr<connection_handle> body_handle;
+    pooled_ptr<response_reader> resp_reader;
 
     std::unique_ptr<request_reader> req_reader;
     std::unique_ptr<response_state_machine> resp_state_machine;
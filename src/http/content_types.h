@@ -1,6 +1,9 @@
 #ifndef CONTENT_TYPES_H
 #define CONTENT_TYPES_H
 
+#include <cstddef>
+#include <string_view>
+
 namespace http {
 
 enum class content_types
@@ -9,9 +12,113 @@ enum class content_types
     text,
     json,
     hls_playlist,
-    hls_chunk
+    hls_chunk,
+    html,
+    css,
+    javascript,
+    mp4,
+    binary
+};
+
+const size_t content_types_num = 10;
+
+constexpr std::string_view content_type_to_str(content_types type) noexcept
+{
+    switch (type) {
+    case content_types::none:
+        return "";
+    case content_types::text:
+        return "text/plain";
+    case content_types::json:
+        return "application/json";
+    case content_types::hls_playlist:
+        return "application/vnd.apple.mpegurl";
+    case content_types::hls_chunk:
+        return "video/MP2T";
+    case content_types::html:
+        return "text/html";
+    case content_types::css:
+        return "text/css";
+    case content_types::javascript:
+        return "application/javascript";
+    case content_types::mp4:
+        return "video/mp4";
+    case content_types::binary:
+        return "application/octet-stream";
+    }
+    return "";
+}
+
+// text bodies shrink several times, media and binaries don't
+constexpr bool content_type_compressible(content_types type) noexcept
+{
+    switch (type) {
+    case content_types::text:
+    case content_types::json:
+    case content_types::hls_playlist:
+    case content_types::html:
+    case content_types::css:
+    case content_types::javascript:
+        return true;
+    default:
+        break;
+    }
+    return false;
+}
+
+enum class content_encoding
+{
+    identity,
+    gzip,
+    deflate,
+    br
 };
 
+constexpr std::string_view content_encoding_to_str(content_encoding encoding) noexcept
+{
+    switch (encoding) {
+    case content_encoding::identity:
+        return "";
+    case content_encoding::gzip:
+        return "gzip";
+    case content_encoding::deflate:
+        return "deflate";
+    case content_encoding::br:
+        return "br";
+    }
+    return "";
+}
+
+// the type of a file by its extension, unknown ones are binary
+constexpr content_types content_type_by_path(std::string_view path) noexcept
+{
+    const size_t dot = path.rfind('.');
+    const size_t slash = path.rfind('/');
+    if (dot == std::string_view::npos || (slash != std::string_view::npos && dot < slash)) {
+        return content_types::binary;
+    }
+
+    const std::string_view ext = path.substr(dot + 1);
+    if (ext == "m3u8") {
+        return content_types::hls_playlist;
+    } else if (ext == "ts") {
+        return content_types::hls_chunk;
+    } else if (ext == "mp4" || ext == "m4s") {
+        return content_types::mp4;
+    } else if (ext == "json") {
+        return content_types::json;
+    } else if (ext == "txt") {
+        return content_types::text;
+    } else if (ext == "html" || ext == "htm") {
+        return content_types::html;
+    } else if (ext == "css") {
+        return content_types::css;
+    } else if (ext == "js") {
+        return content_types::javascript;
+    }
+    return content_types::binary;
+}
+
 }
 
 #endif // CONTENT_TYPES_H
@@ -0,0 +1,249 @@
+#include "epoll_reactor.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <algorithm>
+
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/sendfile.h>
+
+#include "connection.h"
+#include "../utility/datetime.h"
+
+using namespace http;
+
+epoll_reactor::epoll_reactor(reactor_handler *handler, bool edge_triggered) noexcept :
+    _handler(handler),
+    _edge_triggered(edge_triggered)
+{
+}
+
+epoll_reactor::~epoll_reactor()
+{
+    if (_epoll_d != -1) {
+        ::close(_epoll_d);
+    }
+}
+
+bool epoll_reactor::init(int listen_d, int wake_d) noexcept
+{
+    _epoll_d = epoll_create1(EPOLL_CLOEXEC);
+    if (_epoll_d == -1) {
+        perror("epoll_create");
+        return false;
+    }
+
+    // the listening socket and the eventfd are marked by addresses of the members
+    _listen_d = listen_d;
+    if (_listen_d != -1) {
+        epoll_event in_event;
+        in_event.events = EPOLLIN;
+        in_event.data.ptr = &_listen_d;
+
+        if (epoll_ctl(_epoll_d, EPOLL_CTL_ADD, _listen_d, &in_event) == -1) {
+            perror("epoll_ctl listen");
+            return false;
+        }
+    }
+
+    _wake_d = wake_d;
+    if (_wake_d != -1) {
+        epoll_event in_event;
+        in_event.events = EPOLLIN;
+        in_event.data.ptr = &_wake_d;
+
+        if (epoll_ctl(_epoll_d, EPOLL_CTL_ADD, _wake_d, &in_event) == -1) {
+            perror("epoll_ctl eventfd");
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void epoll_reactor::wait(int timeout_msecs) noexcept
+{
+    if (_accept_resume_msecs != -1) {
+        const int64_t pause_msecs = std::max<int64_t>(_accept_resume_msecs - datetime::monotonic_msecs(), 0);
+        if (timeout_msecs == -1 || pause_msecs < timeout_msecs) {
+            timeout_msecs = static_cast<int>(pause_msecs);
+        }
+    }
+    _events_num = epoll_wait(_epoll_d, _events, max_events, timeout_msecs);
+}
+
+void epoll_reactor::dispatch() noexcept
+{
+    for (int i = 0; i < _events_num; ++i) {
+        const epoll_event& event = _events[i];
+        if (event.data.ptr == &_listen_d) {
+            handle_accept();
+            continue;
+        }
+        if (event.data.ptr == &_wake_d) {
+            _handler->handle_wake();
+            continue;
+        }
+
+        connection* conn = reinterpret_cast<connection*>(event.data.ptr);
+        if (conn == nullptr) {
+            // the connection was closed after the events were got
+            continue;
+        }
+        if (event.events&EPOLLRDHUP) {
+            conn->hangup = true;
+        }
+        if (event.events&EPOLLIN) {
+            conn->readable = true;
+        }
+        if (event.events&EPOLLOUT) {
+            conn->writable = true;
+        }
+
+        _handler->handle_event(conn);
+    }
+    _events_num = 0;
+
+    resume_accept();
+}
+
+bool epoll_reactor::edge_triggered() const noexcept
+{
+    return _edge_triggered;
+}
+
+bool epoll_reactor::open(connection *conn) noexcept
+{
+    epoll_event in_event;
+    in_event.events = events_of(conn);
+    in_event.data.ptr = conn;
+
+    if (epoll_ctl(_epoll_d, EPOLL_CTL_ADD, conn->sock_d, &in_event) == -1) {
+        perror("epoll_ctl");
+        return false;
+    }
+
+    conn->events = in_event.events;
+    return true;
+}
+
+bool epoll_reactor::watch(connection *conn) noexcept
+{
+    const uint32_t events = events_of(conn);
+    if (conn->events == events) {
+        return true;
+    }
+
+    epoll_event event;
+    event.events = events;
+    event.data.ptr = conn;
+    if (epoll_ctl(_epoll_d, EPOLL_CTL_MOD, conn->sock_d, &event) == -1) {
+        perror("epoll_ctl mod");
+        return false;
+    }
+
+    conn->events = events;
+    return true;
+}
+
+void epoll_reactor::close(connection *conn) noexcept
+{
+    // a pending event would touch the released connection or close a reused descriptor
+    for (int i = 0; i < _events_num; ++i) {
+        if (_events[i].data.ptr == conn) {
+            _events[i].data.ptr = nullptr;
+        }
+    }
+
+    ::close(conn->sock_d);
+    _handler->handle_closed(conn);
+}
+
+ssize_t epoll_reactor::read(connection *conn, char *buff, size_t size) noexcept
+{
+    return ::read(conn->sock_d, buff, size);
+}
+
+ssize_t epoll_reactor::send(connection *conn, const iovec *iov, size_t iov_num, bool more) noexcept
+{
+    msghdr msg = {};
+    msg.msg_iov = const_cast<iovec*>(iov);
+    msg.msg_iovlen = iov_num;
+
+    int flags = MSG_NOSIGNAL;
+    if (more) {
+        flags |= MSG_MORE;
+    }
+
+    return sendmsg(conn->sock_d, &msg, flags);
+}
+
+ssize_t epoll_reactor::sendfile(connection *conn, int file_d, off_t offset, size_t size) noexcept
+{
+    return ::sendfile(conn->sock_d, file_d, &offset, size);
+}
+
+void epoll_reactor::handle_accept() noexcept
+{
+    while (true) {
+        int sock_d = accept4(_listen_d, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (sock_d != -1) {
+            _handler->handle_accept(sock_d);
+        } else {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                perror("accept");
+            }
+            // the listening socket stays readable, so it isn't watched for a while
+            if ((errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM)
+                    && watch_listen(0)) {
+                _accept_resume_msecs = datetime::monotonic_msecs() + accept_pause_msecs;
+            }
+            break;
+        }
+    }
+}
+
+void epoll_reactor::resume_accept() noexcept
+{
+    if (_accept_resume_msecs == -1 || datetime::monotonic_msecs() < _accept_resume_msecs) {
+        return;
+    }
+
+    _accept_resume_msecs = -1;
+    watch_listen(EPOLLIN);
+}
+
+bool epoll_reactor::watch_listen(uint32_t events) noexcept
+{
+    epoll_event in_event;
+    in_event.events = events;
+    in_event.data.ptr = &_listen_d;
+
+    if (epoll_ctl(_epoll_d, EPOLL_CTL_MOD, _listen_d, &in_event) == -1) {
+        perror("epoll_ctl listen");
+        return false;
+    }
+    return true;
+}
+
+uint32_t epoll_reactor::events_of(const connection *conn) const noexcept
+{
+    if (_edge_triggered) {
+        return EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    }
+
+    switch (conn->state) {
+    case connection_state::read_request:
+    case connection_state::read_response:
+        return EPOLLIN | EPOLLRDHUP;
+    case connection_state::write_response:
+    case connection_state::write_request:
+        return EPOLLOUT | EPOLLRDHUP;
+    case connection_state::wait_response:
+    case connection_state::wait_handler:
+    case connection_state::wait_body:
+        return EPOLLRDHUP;
+    }
+    return EPOLLIN | EPOLLRDHUP;
+}
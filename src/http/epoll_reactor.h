@@ -0,0 +1,56 @@
+#ifndef EPOLL_REACTOR_H
+#define EPOLL_REACTOR_H
+
+#include <sys/epoll.h>
+
+#include "reactor.h"
+
+namespace http {
+
+class epoll_reactor : public reactor
+{
+public:
+    // an edge-triggered socket is registered for all events once,
+    // so there are no epoll_ctl calls while a connection switches between read and write
+    epoll_reactor(reactor_handler* handler, bool edge_triggered) noexcept;
+    ~epoll_reactor() override;
+
+    bool init(int listen_d, int wake_d) noexcept override;
+    void wait(int timeout_msecs) noexcept override;
+    void dispatch() noexcept override;
+    bool edge_triggered() const noexcept override;
+
+    bool open(connection* conn) noexcept override;
+    bool watch(connection* conn) noexcept override;
+    void close(connection* conn) noexcept override;
+
+    ssize_t read(connection* conn, char* buff, size_t size) noexcept override;
+    ssize_t send(connection* conn, const iovec* iov, size_t iov_num, bool more) noexcept override;
+    ssize_t sendfile(connection* conn, int file_d, off_t offset, size_t size) noexcept override;
+
+private:
+    void handle_accept() noexcept;
+    void resume_accept() noexcept;
+    bool watch_listen(uint32_t events) noexcept;
+
+    uint32_t events_of(const connection* conn) const noexcept;
+
+private:
+    static const size_t max_events = 1000;
+
+    reactor_handler* _handler = nullptr;
+    bool _edge_triggered = false;
+
+    int _epoll_d = -1;
+    int _listen_d = -1;
+    int _wake_d = -1;
+    // accepting is paused till then, -1 if it isn't
+    int64_t _accept_resume_msecs = -1;
+
+    epoll_event _events[max_events];
+    int _events_num = 0;
+};
+
+}
+
+#endif // EPOLL_REACTOR_H
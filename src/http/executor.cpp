@@ -0,0 +1,262 @@
+#include "executor.h"
+
+#include <chrono>
+#include <algorithm>
+#include <system_error>
+
+#include <glog/logging.h>
+
+using namespace http;
+
+namespace {
+
+thread_local const executor* current_executor = nullptr;
+thread_local size_t current_index = 0;
+
+int64_t monotonic_usecs() noexcept
+{
+    using namespace std::chrono;
+    return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+}
+
+executor::executor(size_t threads_num) noexcept :
+    _threads_num(threads_num)
+{
+}
+
+executor::~executor()
+{
+    stop();
+}
+
+void executor::set_threads_num(size_t threads_num) noexcept
+{
+    std::lock_guard<std::mutex> lock(_start_mutex);
+    if (!_started) {
+        _threads_num = threads_num;
+    }
+}
+
+void executor::post(std::function<void()> task) noexcept
+{
+    if (_stopped.load(std::memory_order_acquire)) {
+        return;
+    }
+    if (!_started.load(std::memory_order_acquire) && !start()) {
+        // the handler still gets its response
+        task();
+        return;
+    }
+    if (!_isRunning.load(std::memory_order_relaxed)) {
+        return;
+    }
+
+    const size_t index = current_executor == this
+            ? current_index
+            : _next.fetch_add(1, std::memory_order_relaxed) % _queues.size();
+
+    // counted before the push, so a thread which sees the count doesn't fall asleep
+    _queued.fetch_add(1);
+    push(index, {std::move(task), monotonic_usecs()});
+
+    if (_sleeping.load() > 0) {
+        { std::lock_guard<std::mutex> lock(_sleep_mutex); }
+        _sleep_cond.notify_one();
+    }
+}
+
+void executor::stop() noexcept
+{
+    {
+        std::lock_guard<std::mutex> lock(_start_mutex);
+        _stopped.store(true, std::memory_order_release);
+        if (!_started) {
+            return;
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_sleep_mutex);
+        _isRunning.store(false);
+    }
+    _sleep_cond.notify_all();
+
+    for (auto&& thread : _threads) {
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+
+    // the queues stay, post() and stats() read them without the lock
+    std::lock_guard<std::mutex> lock(_start_mutex);
+    _threads.clear();
+    for (auto&& q : _queues) {
+        std::lock_guard<std::mutex> queue_lock(q->mutex);
+        q->tasks.clear();
+    }
+    _queued.store(0);
+    _started.store(false);
+}
+
+void executor::reopen() noexcept
+{
+    std::lock_guard<std::mutex> lock(_start_mutex);
+    _stopped.store(false, std::memory_order_release);
+}
+
+executor_stats executor::stats() const noexcept
+{
+    executor_stats res;
+    const size_t queues_num = _queues_num.load(std::memory_order_acquire);
+
+    res.queued = _queued.load(std::memory_order_relaxed);
+    for (size_t i=0; i<queues_num; ++i) {
+        auto&& q = _queues[i];
+        res.executed += q->executed.load(std::memory_order_relaxed);
+        res.stolen += q->stolen.load(std::memory_order_relaxed);
+        res.wait_usecs += q->wait_usecs.load(std::memory_order_relaxed);
+        res.run_usecs += q->run_usecs.load(std::memory_order_relaxed);
+    }
+    return res;
+}
+
+bool executor::start() noexcept
+{
+    std::lock_guard<std::mutex> lock(_start_mutex);
+    if (_started) {
+        return true;
+    }
+    if (_stopped) {
+        // the task is dropped by the caller
+        return true;
+    }
+
+    // the queues are made once, a restart gets the same number of threads
+    if (_queues.empty()) {
+        size_t threads_num = _threads_num;
+        if (threads_num == 0) {
+            threads_num = std::max(1u, std::thread::hardware_concurrency());
+        }
+
+        for (size_t i=0; i<threads_num; ++i) {
+            _queues.push_back(std::make_unique<queue>());
+        }
+        _queues_num.store(_queues.size(), std::memory_order_release);
+    }
+    const size_t threads_num = _queues.size();
+
+    _isRunning.store(true);
+    for (size_t i=0; i<threads_num; ++i) {
+        try {
+            _threads.emplace_back(&executor::loop, this, i);
+        } catch (const std::system_error& e) {
+            LOG(ERROR) << "failed to start an executor thread: " << e.what();
+            if (_threads.empty()) {
+                _isRunning.store(false);
+                return false;
+            }
+            break;
+        }
+    }
+
+    _started.store(true, std::memory_order_release);
+    return true;
+}
+
+void executor::loop(size_t index) noexcept
+{
+    current_executor = this;
+    current_index = index;
+
+    task t;
+    while (_isRunning) {
+        if (pop(index, t) || steal(index, t)) {
+            _queued.fetch_sub(1);
+            run(index, t);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(_sleep_mutex);
+        _sleeping.fetch_add(1);
+        _sleep_cond.wait(lock, [this]() {
+            return _queued.load() > 0 || !_isRunning.load();
+        });
+        _sleeping.fetch_sub(1);
+    }
+}
+
+void executor::run(size_t index, task &t) noexcept
+{
+    auto&& q = _queues[index];
+
+    const int64_t started_usecs = monotonic_usecs();
+    t.func();
+    const int64_t finished_usecs = monotonic_usecs();
+    t.func = nullptr;
+
+    stats_increment(q->executed);
+    q->wait_usecs.store(q->wait_usecs.load(std::memory_order_relaxed) + (started_usecs - t.posted_usecs),
+                        std::memory_order_relaxed);
+    q->run_usecs.store(q->run_usecs.load(std::memory_order_relaxed) + (finished_usecs - started_usecs),
+                       std::memory_order_relaxed);
+}
+
+bool executor::pop(size_t index, task &t) noexcept
+{
+    auto&& q = _queues[index];
+
+    std::lock_guard<std::mutex> lock(q->mutex);
+    if (q->tasks.empty()) {
+        return false;
+    }
+
+    t = std::move(q->tasks.front());
+    q->tasks.pop_front();
+    return true;
+}
+
+bool executor::steal(size_t index, task &t) noexcept
+{
+    const size_t queues_num = _queues.size();
+    for (size_t i=1; i<queues_num; ++i) {
+        auto&& q = _queues[(index + i) % queues_num];
+
+        std::lock_guard<std::mutex> lock(q->mutex);
+        if (q->tasks.empty()) {
+            continue;
+        }
+
+        t = std::move(q->tasks.back());
+        q->tasks.pop_back();
+        stats_increment(_queues[index]->stolen);
+        return true;
+    }
+    return false;
+}
+
+void executor::push(size_t index, task &&t) noexcept
+{
+    auto&& q = _queues[index];
+
+    std::lock_guard<std::mutex> lock(q->mutex);
+    q->tasks.push_back(std::move(t));
+}
+
+async_request_handler http::offload(executor &exec, request_handler handler)
+{
+    return [&exec, handler](std::shared_ptr<request> req, completion_token token) {
+        // the worker has detached the headers already, the call is kept
+        // for the handlers called outside of it
+        req->header_fields.detach();
+
+        exec.post([handler, req, token]() {
+            // the client can be gone while the task waited
+            if (token.cancelled()) {
+                return;
+            }
+            token.complete(handler(req));
+        });
+    };
+}
@@ -0,0 +1,99 @@
+#ifndef EXECUTOR_H
+#define EXECUTOR_H
+
+#include <deque>
+#include <mutex>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <functional>
+#include <condition_variable>
+
+#include "handlers.h"
+#include "stats.h"
+
+namespace http {
+
+// Thread pool for CPU heavy handlers, so they don't stall the connections of a worker.
+// Every thread has its own queue which it takes in order, an idle thread
+// steals from the tail of the other queues.
+class executor
+{
+public:
+    // 0 threads is the number of cores
+    explicit executor(size_t threads_num = 0) noexcept;
+    ~executor();
+
+    executor(const executor&) = delete;
+    executor& operator=(const executor&) = delete;
+
+    // takes effect till the first task, the threads are started by it,
+    // a restart after stop keeps the number
+    void set_threads_num(size_t threads_num) noexcept;
+    // tasks posted from a pool thread go to its own queue,
+    // they are dropped after stop
+    void post(std::function<void()> task) noexcept;
+    // waits for the running tasks, the queued ones are dropped
+    void stop() noexcept;
+    // allows posting after stop, the threads are started by the next task
+    void reopen() noexcept;
+
+    // can be called from any thread
+    executor_stats stats() const noexcept;
+
+private:
+    struct task
+    {
+        std::function<void()> func;
+        int64_t posted_usecs = 0;
+    };
+
+    // counters are written by the owner thread of the queue
+    struct alignas(64) queue
+    {
+        std::mutex mutex;
+        std::deque<task> tasks;
+
+        std::atomic<size_t> executed{0};
+        std::atomic<size_t> stolen{0};
+        std::atomic<uint64_t> wait_usecs{0};
+        std::atomic<uint64_t> run_usecs{0};
+    };
+
+    bool start() noexcept;
+    void loop(size_t index) noexcept;
+    void run(size_t index, task& t) noexcept;
+
+    bool pop(size_t index, task& t) noexcept;
+    bool steal(size_t index, task& t) noexcept;
+    void push(size_t index, task&& t) noexcept;
+
+private:
+    size_t _threads_num = 0;
+    // made by the first start and kept till the destructor
+    std::vector<std::unique_ptr<queue>> _queues;
+    std::atomic<size_t> _queues_num{0};
+    std::vector<std::thread> _threads;
+
+    std::mutex _start_mutex;
+    std::atomic<bool> _started{false};
+    std::atomic<bool> _stopped{false};
+    std::atomic<bool> _isRunning{false};
+
+    std::atomic<size_t> _next{0};
+    std::atomic<size_t> _queued{0};
+
+    // idle threads sleep till a task is posted
+    std::mutex _sleep_mutex;
+    std::condition_variable _sleep_cond;
+    std::atomic<size_t> _sleeping{0};
+};
+
+// runs the handler on the executor, the response goes back to the worker
+// of the connection through its mailbox
+async_request_handler offload(executor& exec, request_handler handler);
+
+}
+
+#endif // EXECUTOR_H
@@ -0,0 +1,191 @@
+#include "file_cache.h"
+
+#include <cstdio>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "http_date.h"
+#include "../utility/datetime.h"
+
+using namespace http;
+
+namespace {
+
+// a strong tag changes with the inode, the size and the mtime
+std::string make_etag(const struct stat& st)
+{
+    char buff[64];
+    const int size = snprintf(buff, sizeof(buff), "\"%llx-%llx-%llx\"",
+                              static_cast<unsigned long long>(st.st_ino),
+                              static_cast<unsigned long long>(st.st_size),
+                              static_cast<unsigned long long>(st.st_mtim.tv_sec) * 1000000000ull
+                              + static_cast<unsigned long long>(st.st_mtim.tv_nsec));
+    return std::string(buff, size > 0 ? static_cast<size_t>(size) : 0);
+}
+
+}
+
+file_entry::~file_entry()
+{
+    if (fd != -1) {
+        close(fd);
+    }
+}
+
+file_cache::file_cache() noexcept
+{
+}
+
+void file_cache::set_limits(size_t capacity, int64_t ttl_msecs) noexcept
+{
+    // a nonzero capacity keeps at least one file per shard
+    _shard_capacity.store(capacity > 0 ? (capacity + shards_num - 1) / shards_num : 0);
+    _ttl_msecs.store(ttl_msecs);
+}
+
+std::shared_ptr<const file_entry> file_cache::open(const std::string &path, bool remember_missing) noexcept
+{
+    const int64_t now_msecs = datetime::monotonic_msecs();
+    const size_t capacity = _shard_capacity.load(std::memory_order_relaxed);
+    if (capacity == 0) {
+        return open_file(path, now_msecs);
+    }
+
+    shard& s = _shards[std::hash<std::string>()(path) % shards_num];
+    const int64_t ttl_msecs = _ttl_msecs.load(std::memory_order_relaxed);
+
+    std::shared_ptr<file_entry> entry;
+    int64_t missing_checked_msecs = -1;
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        auto it = s.entries.find(path);
+        if (it != s.entries.end()) {
+            s.lru.splice(s.lru.begin(), s.lru, it->second);
+            entry = *it->second;
+        } else if (remember_missing) {
+            auto missing_it = s.missing.find(path);
+            if (missing_it != s.missing.end()) {
+                s.missing_lru.splice(s.missing_lru.begin(), s.missing_lru, missing_it->second);
+                missing_checked_msecs = missing_it->second->checked_msecs;
+            }
+        }
+    }
+
+    if (entry) {
+        const int64_t checked_msecs = entry->checked_msecs.load(std::memory_order_relaxed);
+        if (now_msecs - checked_msecs < ttl_msecs) {
+            return entry;
+        }
+
+        // the file is checked out of the lock, an unchanged one stays open
+        struct stat st;
+        if (stat(path.data(), &st) == 0 && same_file(*entry, st)) {
+            entry->checked_msecs.store(now_msecs, std::memory_order_relaxed);
+            return entry;
+        }
+    } else if (missing_checked_msecs != -1 && now_msecs - missing_checked_msecs < ttl_msecs) {
+        return nullptr;
+    }
+
+    std::shared_ptr<file_entry> fresh = open_file(path, now_msecs);
+    std::lock_guard<std::mutex> lock(s.mutex);
+    if (fresh) {
+        erase_missing(s, path);
+        insert(s, fresh);
+        return fresh;
+    }
+
+    erase(s, path);
+    if (remember_missing) {
+        insert_missing(s, path, now_msecs);
+    }
+    return nullptr;
+}
+
+std::shared_ptr<file_entry> file_cache::open_file(const std::string &path, int64_t now_msecs) noexcept
+{
+    const int fd = ::open(path.data(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return nullptr;
+    }
+
+    auto entry = std::make_shared<file_entry>();
+    entry->path = path;
+    entry->fd = fd;
+
+    struct stat st;
+    if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode)) {
+        return nullptr;
+    }
+
+    entry->size = static_cast<size_t>(st.st_size);
+    entry->dev = st.st_dev;
+    entry->ino = st.st_ino;
+    entry->mtime = st.st_mtim;
+    entry->etag = make_etag(st);
+    entry->last_modified = format_http_date(st.st_mtim.tv_sec);
+    entry->checked_msecs.store(now_msecs, std::memory_order_relaxed);
+    return entry;
+}
+
+bool file_cache::same_file(const file_entry &entry, const struct stat &st) noexcept
+{
+    return entry.dev == st.st_dev
+            && entry.ino == st.st_ino
+            && entry.size == static_cast<size_t>(st.st_size)
+            && entry.mtime.tv_sec == st.st_mtim.tv_sec
+            && entry.mtime.tv_nsec == st.st_mtim.tv_nsec;
+}
+
+void file_cache::insert(shard &s, const std::shared_ptr<file_entry> &entry) noexcept
+{
+    auto it = s.entries.find(entry->path);
+    if (it != s.entries.end()) {
+        *it->second = entry;
+        s.lru.splice(s.lru.begin(), s.lru, it->second);
+        return;
+    }
+
+    // the least recently used entry goes away, the responses which hold it aren't affected
+    if (s.lru.size() >= _shard_capacity.load(std::memory_order_relaxed)) {
+        s.entries.erase(s.lru.back()->path);
+        s.lru.pop_back();
+    }
+    s.lru.push_front(entry);
+    s.entries.emplace(entry->path, s.lru.begin());
+}
+
+void file_cache::erase(shard &s, const std::string &path) noexcept
+{
+    auto it = s.entries.find(path);
+    if (it != s.entries.end()) {
+        s.lru.erase(it->second);
+        s.entries.erase(it);
+    }
+}
+
+void file_cache::insert_missing(shard &s, const std::string &path, int64_t now_msecs) noexcept
+{
+    auto it = s.missing.find(path);
+    if (it != s.missing.end()) {
+        it->second->checked_msecs = now_msecs;
+        return;
+    }
+
+    if (s.missing_lru.size() >= _shard_capacity.load(std::memory_order_relaxed)) {
+        s.missing.erase(s.missing_lru.back().path);
+        s.missing_lru.pop_back();
+    }
+    s.missing_lru.push_front({path, now_msecs});
+    s.missing.emplace(path, s.missing_lru.begin());
+}
+
+void file_cache::erase_missing(shard &s, const std::string &path) noexcept
+{
+    auto it = s.missing.find(path);
+    if (it != s.missing.end()) {
+        s.missing_lru.erase(it->second);
+        s.missing.erase(it);
+    }
+}
@@ -0,0 +1,98 @@
+#ifndef FILE_CACHE_H
+#define FILE_CACHE_H
+
+#include <list>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <cstdint>
+#include <unordered_map>
+
+#include <sys/stat.h>
+
+namespace http {
+
+// An open file and its metadata, shared by the responses which send it.
+// The descriptor is closed by the last owner, so a replaced entry is still sent.
+struct file_entry
+{
+    file_entry() noexcept = default;
+    ~file_entry();
+
+    file_entry(const file_entry&) = delete;
+    file_entry& operator=(const file_entry&) = delete;
+
+    std::string path;
+    int fd = -1;
+    size_t size = 0;
+    dev_t dev = 0;
+    ino_t ino = 0;
+    timespec mtime = {};
+    // validators made of the metadata
+    std::string etag;
+    std::string last_modified;
+
+    // the last time the file was checked by stat
+    std::atomic<int64_t> checked_msecs{0};
+};
+
+// Sharded LRU cache of open regular files by their paths. An entry is used without
+// syscalls during the ttl, then it's checked by stat and reopened if the file
+// has changed. Missing files aren't cached, so random paths don't evict real files,
+// only the missing ones asked for by remember_missing are kept apart.
+// It's shared by all workers.
+class file_cache
+{
+public:
+    file_cache() noexcept;
+
+    file_cache(const file_cache&) = delete;
+    file_cache& operator=(const file_cache&) = delete;
+
+    // 0 capacity opens files for every request
+    void set_limits(size_t capacity, int64_t ttl_msecs) noexcept;
+
+    // returns nullptr if the file isn't found or isn't a regular file,
+    // remember_missing is for paths made by the server, e.g. precompressed siblings
+    std::shared_ptr<const file_entry> open(const std::string& path, bool remember_missing = false) noexcept;
+
+private:
+    struct missing_entry
+    {
+        std::string path;
+        int64_t checked_msecs = 0;
+    };
+
+    typedef std::list<std::shared_ptr<file_entry>> lru_list;
+    typedef std::list<missing_entry> missing_list;
+
+    // the recently used entries go first
+    struct shard
+    {
+        std::mutex mutex;
+        lru_list lru;
+        std::unordered_map<std::string, lru_list::iterator> entries;
+        missing_list missing_lru;
+        std::unordered_map<std::string, missing_list::iterator> missing;
+    };
+
+    static std::shared_ptr<file_entry> open_file(const std::string& path, int64_t now_msecs) noexcept;
+    static bool same_file(const file_entry& entry, const struct stat& st) noexcept;
+
+    void insert(shard& s, const std::shared_ptr<file_entry>& entry) noexcept;
+    void erase(shard& s, const std::string& path) noexcept;
+    void insert_missing(shard& s, const std::string& path, int64_t now_msecs) noexcept;
+    void erase_missing(shard& s, const std::string& path) noexcept;
+
+private:
+    static const size_t shards_num = 16;
+
+    shard _shards[shards_num];
+    std::atomic<size_t> _shard_capacity{0};
+    std::atomic<int64_t> _ttl_msecs{0};
+};
+
+}
+
+#endif // FILE_CACHE_H
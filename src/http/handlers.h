@@ -7,13 +7,22 @@
 #include "uri.h"
 #include "request.h"
 #include "response.h"
+#include "completion.h"
 
 namespace http {
 
 typedef std::function<response(std::shared_ptr<request>)> request_handler;
+// doesn't block the worker, the response is given to the token later from any thread
+typedef std::function<void(std::shared_ptr<request>, completion_token)> async_request_handler;
 typedef std::function<void(std::shared_ptr<response>)> response_handler;
 typedef std::function<int(std::shared_ptr<request>, uri)> uri_handler;
 typedef std::function<int(std::shared_ptr<request>, string, string)> header_handler;
+// returned by a body handler to stop reading the body till the token is resumed
+const int body_pause = -1;
+// gets a request body by chunks, the last chunk is flagged, the chunk is valid
+// only during the call, it runs on the worker thread and mustn't block it,
+// returns 0 to go on, body_pause or a http code to reject the request
+typedef std::function<int(std::shared_ptr<request>, string, bool, body_token)> body_handler;
 
 }
 
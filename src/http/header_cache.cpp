@@ -0,0 +1,91 @@
+#include "header_cache.h"
+
+#include <ctime>
+
+using namespace http;
+
+namespace {
+
+const int precomputed_codes[] = {200, 201, 204, 206, 301, 302, 304,
+                                 400, 401, 403, 404, 405, 408, 411, 413, 416,
+                                 500, 503};
+const size_t precomputed_codes_num = sizeof(precomputed_codes) / sizeof(precomputed_codes[0]);
+
+}
+
+header_cache::header_cache() noexcept
+{
+    _blocks.resize(precomputed_codes_num * content_types_num * 2);
+    for (size_t i=0; i<precomputed_codes_num; ++i) {
+        for (size_t type=0; type<content_types_num; ++type) {
+            for (bool keep_alive : {false, true}) {
+                const int code = precomputed_codes[i];
+                const content_types content_type = static_cast<content_types>(type);
+
+                std::string& block = _blocks[block_index(static_cast<int>(i), content_type, keep_alive)];
+                header_writer writer(block);
+                format_block(writer, code, content_type, keep_alive);
+            }
+        }
+    }
+}
+
+void header_cache::update(int64_t unix_time) noexcept
+{
+    if (unix_time == _date_time) {
+        return;
+    }
+    _date_time = unix_time;
+
+    time_t time = static_cast<time_t>(unix_time);
+    tm gmt;
+    gmtime_r(&time, &gmt);
+    _date_size = strftime(_date, sizeof(_date), "Date: %a, %d %b %Y %H:%M:%S GMT\r\n", &gmt);
+}
+
+std::string_view header_cache::date() const noexcept
+{
+    return std::string_view(_date, _date_size);
+}
+
+void header_cache::write_block(header_writer &writer,
+                               int code,
+                               content_types type,
+                               bool keep_alive) const noexcept
+{
+    int index = code_index(code);
+    if (index != -1) {
+        writer.append(_blocks[block_index(index, type, keep_alive)]);
+    } else {
+        format_block(writer, code, type, keep_alive);
+    }
+}
+
+void header_cache::format_block(header_writer &writer,
+                                int code,
+                                content_types type,
+                                bool keep_alive) noexcept
+{
+    writer.status_line(code);
+    writer.header("Access-Control-Allow-Origin", "*");
+    writer.header("Connection", keep_alive ? "keep-alive" : "close");
+    if (type != content_types::none) {
+        writer.header("Content-Type", content_type_to_str(type));
+    }
+}
+
+int header_cache::code_index(int code) noexcept
+{
+    for (size_t i=0; i<precomputed_codes_num; ++i) {
+        if (precomputed_codes[i] == code) {
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
+
+size_t header_cache::block_index(int code_index, content_types type, bool keep_alive) noexcept
+{
+    return (static_cast<size_t>(code_index) * content_types_num + static_cast<size_t>(type)) * 2
+            + (keep_alive ? 1 : 0);
+}
@@ -0,0 +1,50 @@
+#ifndef HEADER_CACHE_H
+#define HEADER_CACHE_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <string_view>
+
+#include "content_types.h"
+#include "header_writer.h"
+
+namespace http {
+
+// Per-worker cache of the Date header and of the status line with
+// common headers for frequent (code, content type) pairs.
+class header_cache
+{
+public:
+    header_cache() noexcept;
+
+    // the Date header is formatted again only when the second changes
+    void update(int64_t unix_time) noexcept;
+    std::string_view date() const noexcept;
+
+    // the status line, Access-Control-Allow-Origin, Connection and Content-Type
+    void write_block(header_writer& writer,
+                     int code,
+                     content_types type,
+                     bool keep_alive) const noexcept;
+
+private:
+    static void format_block(header_writer& writer,
+                             int code,
+                             content_types type,
+                             bool keep_alive) noexcept;
+
+    static int code_index(int code) noexcept;
+    static size_t block_index(int code_index, content_types type, bool keep_alive) noexcept;
+
+private:
+    int64_t _date_time = -1;
+    char _date[64] = {};
+    size_t _date_size = 0;
+
+    std::vector<std::string> _blocks;
+};
+
+}
+
+#endif // HEADER_CACHE_H
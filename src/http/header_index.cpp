@@ -0,0 +1,176 @@
+#include "header_index.h"
+
+#include <algorithm>
+
+using namespace http;
+
+known_header header_index::to_known(string name) noexcept
+{
+    // the length cuts most of the names without comparing
+    switch (name.size()) {
+    case 4:
+        if (name.compare_nocase("Host") == 0) {
+            return known_header::host;
+        }
+        break;
+    case 5:
+        if (name.compare_nocase("Range") == 0) {
+            return known_header::range;
+        }
+        break;
+    case 8:
+        if (name.compare_nocase("If-Range") == 0) {
+            return known_header::if_range;
+        }
+        break;
+    case 10:
+        if (name.compare_nocase("Connection") == 0) {
+            return known_header::connection;
+        }
+        break;
+    case 13:
+        if (name.compare_nocase("If-None-Match") == 0) {
+            return known_header::if_none_match;
+        }
+        break;
+    case 14:
+        if (name.compare_nocase("Content-Length") == 0) {
+            return known_header::content_length;
+        }
+        break;
+    case 15:
+        if (name.compare_nocase("Accept-Encoding") == 0) {
+            return known_header::accept_encoding;
+        }
+        break;
+    case 17:
+        if (name.compare_nocase("Transfer-Encoding") == 0) {
+            return known_header::transfer_encoding;
+        }
+        if (name.compare_nocase("If-Modified-Since") == 0) {
+            return known_header::if_modified_since;
+        }
+        break;
+    }
+    return known_header::none;
+}
+
+void header_index::add(string name, string value)
+{
+    _fields.push_back({name, value});
+    _detached = false;
+}
+
+void header_index::set(known_header header, string value) noexcept
+{
+    if (header == known_header::none) {
+        return;
+    }
+
+    const size_t i = static_cast<size_t>(header);
+    _known[i] = value;
+    _has_known[i] = true;
+    _detached = false;
+}
+
+void header_index::clear() noexcept
+{
+    _fields.clear();
+    _storage.reset();
+    _detached = false;
+    for (size_t i=0; i<known_headers_num; ++i) {
+        _known[i] = string();
+        _has_known[i] = false;
+    }
+}
+
+void header_index::detach()
+{
+    if (_detached) {
+        return;
+    }
+
+    size_t size = 0;
+    for (auto&& field : _fields) {
+        size += field.name.size() + field.value.size();
+    }
+    for (size_t i=0; i<known_headers_num; ++i) {
+        size += _known[i].size();
+    }
+
+    std::shared_ptr<char[]> storage(new char[size]);
+    size_t pos = 0;
+    auto keep = [&storage, &pos](string& str) {
+        std::copy(str.data(), str.data() + str.size(), storage.get() + pos);
+        str = string(storage.get() + pos, str.size());
+        pos += str.size();
+    };
+
+    for (auto&& field : _fields) {
+        keep(field.name);
+        keep(field.value);
+    }
+    for (size_t i=0; i<known_headers_num; ++i) {
+        keep(_known[i]);
+    }
+    _storage.swap(storage);
+    _detached = true;
+}
+
+bool header_index::empty() const noexcept
+{
+    return _fields.empty();
+}
+
+size_t header_index::size() const noexcept
+{
+    return _fields.size();
+}
+
+const header_field &header_index::operator[](size_t i) const noexcept
+{
+    return _fields[i];
+}
+
+const header_field *header_index::begin() const noexcept
+{
+    return _fields.begin();
+}
+
+const header_field *header_index::end() const noexcept
+{
+    return _fields.end();
+}
+
+bool header_index::find(const char *name, string &value) const noexcept
+{
+    for (auto&& field : _fields) {
+        if (field.name.compare_nocase(name) == 0) {
+            value = field.value;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool header_index::get(known_header header, string &value) const noexcept
+{
+    if (header == known_header::none) {
+        return false;
+    }
+
+    const size_t i = static_cast<size_t>(header);
+    if (!_has_known[i]) {
+        return false;
+    }
+
+    value = _known[i];
+    return true;
+}
+
+void header_index::copy_to(std::map<std::string, std::string> &headers) const
+{
+    for (auto&& field : _fields) {
+        headers.insert({field.name.to_str(), field.value.to_str()});
+    }
+}
@@ -0,0 +1,77 @@
+#ifndef HEADER_INDEX_H
+#define HEADER_INDEX_H
+
+#include <map>
+#include <memory>
+#include <string>
+#include <cstdint>
+
+#include "str.h"
+#include "small_vector.h"
+
+namespace http {
+
+enum class known_header
+{
+    host,
+    content_length,
+    connection,
+    range,
+    if_range,
+    if_none_match,
+    if_modified_since,
+    accept_encoding,
+    transfer_encoding,
+    none
+};
+
+const size_t known_headers_num = static_cast<size_t>(known_header::none);
+
+struct header_field
+{
+    string name;
+    string value;
+};
+
+// Received headers as views into the receive buffer of the connection.
+// Well-known headers are also kept in slots, they're recorded even if
+// the header handler doesn't save the header.
+class header_index
+{
+public:
+    static known_header to_known(string name) noexcept;
+
+    void add(string name, string value);
+    void set(known_header header, string value) noexcept;
+    void clear() noexcept;
+    // copies the viewed bytes into own storage, so the fields outlive
+    // the receive buffer, e.g. when the request is handled on another thread.
+    // It does nothing if no fields are added since the last call.
+    void detach();
+
+    bool empty() const noexcept;
+    size_t size() const noexcept;
+    const header_field& operator[](size_t i) const noexcept;
+    const header_field* begin() const noexcept;
+    const header_field* end() const noexcept;
+
+    // case-insensitive lookup of a saved header
+    bool find(const char* name, string& value) const noexcept;
+    bool get(known_header header, string& value) const noexcept;
+
+    void copy_to(std::map<std::string, std::string>& headers) const;
+
+private:
+    small_vector<header_field, 16> _fields;
+
+    string _known[known_headers_num];
+    bool _has_known[known_headers_num] = {};
+
+    // shared by copies, the views stay valid
+    std::shared_ptr<char[]> _storage;
+    bool _detached = false;
+};
+
+}
+
+#endif // HEADER_INDEX_H
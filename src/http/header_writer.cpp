@@ -0,0 +1,59 @@
+#include "header_writer.h"
+
+#include "status_codes.h"
+
+using namespace http;
+
+header_writer::header_writer(std::string &out) noexcept :
+    _out(out)
+{
+    // it keeps the capacity
+    _out.clear();
+}
+
+void header_writer::append(std::string_view str) noexcept
+{
+    _out.append(str.data(), str.size());
+}
+
+void header_writer::append(uint64_t number) noexcept
+{
+    char digits[20];
+    size_t pos = sizeof(digits);
+    do {
+        digits[--pos] = static_cast<char>('0' + number % 10);
+        number /= 10;
+    } while (number > 0);
+
+    _out.append(digits + pos, sizeof(digits) - pos);
+}
+
+void header_writer::status_line(int code) noexcept
+{
+    append("HTTP/1.1 ");
+    append(static_cast<uint64_t>(code));
+    append(" ");
+    append(status_code_to_str(code));
+    append("\r\n");
+}
+
+void header_writer::header(std::string_view key, std::string_view value) noexcept
+{
+    append(key);
+    append(": ");
+    append(value);
+    append("\r\n");
+}
+
+void header_writer::header(std::string_view key, uint64_t value) noexcept
+{
+    append(key);
+    append(": ");
+    append(value);
+    append("\r\n");
+}
+
+void header_writer::end() noexcept
+{
+    append("\r\n");
+}
@@ -0,0 +1,31 @@
+#ifndef HEADER_WRITER_H
+#define HEADER_WRITER_H
+
+#include <string>
+#include <cstdint>
+#include <string_view>
+
+namespace http {
+
+// Formats a status or request line and headers into a string that is reused
+// between messages, so nothing is allocated once it has grown enough.
+class header_writer
+{
+public:
+    explicit header_writer(std::string& out) noexcept;
+
+    void append(std::string_view str) noexcept;
+    void append(uint64_t number) noexcept;
+
+    void status_line(int code) noexcept;
+    void header(std::string_view key, std::string_view value) noexcept;
+    void header(std::string_view key, uint64_t value) noexcept;
+    void end() noexcept;
+
+private:
+    std::string& _out;
+};
+
+}
+
+#endif // HEADER_WRITER_H
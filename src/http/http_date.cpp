@@ -0,0 +1,71 @@
+#include "http_date.h"
+
+#include <cstring>
+
+using namespace http;
+
+namespace {
+
+const char* const months[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+                              "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+
+bool parse_digits(const char* buff, size_t size, int& value) noexcept
+{
+    value = 0;
+    for (size_t i=0; i<size; ++i) {
+        if (buff[i] < '0' || buff[i] > '9') {
+            return false;
+        }
+        value = value * 10 + (buff[i] - '0');
+    }
+    return true;
+}
+
+}
+
+std::string http::format_http_date(time_t time)
+{
+    tm gmt;
+    gmtime_r(&time, &gmt);
+
+    char buff[64];
+    const size_t size = strftime(buff, sizeof(buff), "%a, %d %b %Y %H:%M:%S GMT", &gmt);
+    return std::string(buff, size);
+}
+
+bool http::parse_http_date(string str, time_t &time) noexcept
+{
+    // Sun, 06 Nov 1994 08:49:37 GMT
+    const size_t fixdate_size = 29;
+    const char* s = str.data();
+    if (str.size() != fixdate_size || s[3] != ',' || s[4] != ' ' || s[7] != ' ' || s[11] != ' '
+            || s[16] != ' ' || s[19] != ':' || s[22] != ':' || memcmp(s + 25, " GMT", 4) != 0) {
+        return false;
+    }
+
+    tm gmt = {};
+    int day = 0;
+    int year = 0;
+    if (!parse_digits(s + 5, 2, day) || !parse_digits(s + 12, 4, year)
+            || !parse_digits(s + 17, 2, gmt.tm_hour) || !parse_digits(s + 20, 2, gmt.tm_min)
+            || !parse_digits(s + 23, 2, gmt.tm_sec)) {
+        return false;
+    }
+
+    int month = -1;
+    for (int i=0; i<12; ++i) {
+        if (memcmp(s + 8, months[i], 3) == 0) {
+            month = i;
+            break;
+        }
+    }
+    if (month == -1 || day < 1 || day > 31 || gmt.tm_hour > 23 || gmt.tm_min > 59 || gmt.tm_sec > 60) {
+        return false;
+    }
+
+    gmt.tm_mday = day;
+    gmt.tm_mon = month;
+    gmt.tm_year = year - 1900;
+    time = timegm(&gmt);
+    return time != -1;
+}
@@ -0,0 +1,18 @@
+#ifndef HTTP_DATE_H
+#define HTTP_DATE_H
+
+#include <ctime>
+#include <string>
+
+#include "str.h"
+
+namespace http {
+
+// formats an IMF-fixdate like Sun, 06 Nov 1994 08:49:37 GMT
+std::string format_http_date(time_t time);
+// parses an IMF-fixdate, the obsolete formats aren't accepted
+bool parse_http_date(string str, time_t& time) noexcept;
+
+}
+
+#endif // HTTP_DATE_H
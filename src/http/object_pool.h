@@ -0,0 +1,137 @@
+#ifndef OBJECT_POOL_H
+#define OBJECT_POOL_H
+
+#include <new>
+#include <atomic>
+#include <memory>
+#include <utility>
+#include <algorithm>
+
+#include "stats.h"
+
+namespace http {
+
+template<class T>
+class object_pool;
+
+template<class T>
+struct pool_deleter
+{
+    object_pool<T>* pool = nullptr;
+
+    void operator()(T* obj) const noexcept
+    {
+        if (pool != nullptr) {
+            pool->release(obj);
+        } else {
+            delete obj;
+        }
+    }
+};
+
+template<class T>
+using pooled_ptr = std::unique_ptr<T, pool_deleter<T>>;
+
+// Free list of cache line aligned storage for objects of one type.
+// It isn't thread safe and belongs to one worker, only stats can be read from other threads.
+template<class T>
+class object_pool
+{
+public:
+    explicit object_pool(size_t high_water_mark) noexcept :
+        _high_water_mark(high_water_mark)
+    {
+    }
+
+    ~object_pool()
+    {
+        while (_free != nullptr) {
+            free_node* next = _free->next;
+            ::operator delete(_free, std::align_val_t(alignment));
+            _free = next;
+        }
+    }
+
+    object_pool(const object_pool&) = delete;
+    object_pool& operator=(const object_pool&) = delete;
+
+    template<class... Args>
+    T* acquire(Args&&... args)
+    {
+        void* storage = nullptr;
+        if (_free != nullptr) {
+            storage = _free;
+            _free = _free->next;
+            --_free_size;
+            stats_increment(_hits);
+        } else {
+            storage = ::operator new(storage_size, std::align_val_t(alignment));
+            stats_increment(_misses);
+        }
+        update_free_size();
+
+        return new (storage) T(std::forward<Args>(args)...);
+    }
+
+    template<class... Args>
+    pooled_ptr<T> make(Args&&... args)
+    {
+        return pooled_ptr<T>(acquire(std::forward<Args>(args)...), pool_deleter<T>{this});
+    }
+
+    void release(T* obj) noexcept
+    {
+        if (obj == nullptr) {
+            return;
+        }
+
+        obj->~T();
+
+        if (_free_size < _high_water_mark) {
+            free_node* node = reinterpret_cast<free_node*>(obj);
+            node->next = _free;
+            _free = node;
+            ++_free_size;
+        } else {
+            ::operator delete(obj, std::align_val_t(alignment));
+        }
+        update_free_size();
+    }
+
+    pool_stats stats() const noexcept
+    {
+        pool_stats res;
+        res.hits = _hits.load(std::memory_order_relaxed);
+        res.misses = _misses.load(std::memory_order_relaxed);
+        res.free_size = _free_size_stat.load(std::memory_order_relaxed);
+        return res;
+    }
+
+private:
+    struct free_node
+    {
+        free_node* next;
+    };
+
+    void update_free_size() noexcept
+    {
+        _free_size_stat.store(_free_size, std::memory_order_relaxed);
+    }
+
+private:
+    static constexpr size_t cache_line_size = 64;
+    static constexpr size_t alignment = std::max(alignof(T), cache_line_size);
+    static constexpr size_t storage_size = std::max(sizeof(T), sizeof(free_node));
+
+    free_node* _free = nullptr;
+    size_t _free_size = 0;
+    size_t _high_water_mark = 0;
+
+    std::atomic<size_t> _hits = 0;
+    std::atomic<size_t> _misses = 0;
+    std::atomic<size_t> _free_size_stat = 0;
+};
+
+}
+
+#endif // OBJECT_POOL_H
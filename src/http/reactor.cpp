@@ -0,0 +1,28 @@
+#include "reactor.h"
+
+#include <glog/logging.h>
+
+#include "epoll_reactor.h"
+#include "uring_reactor.h"
+
+using namespace http;
+
+std::unique_ptr<reactor> http::make_reactor(const server_config &config,
+                                            reactor_handler *handler,
+                                            int listen_d,
+                                            int wake_d) noexcept
+{
+    if (config.backend == io_backend::io_uring) {
+        auto res = std::make_unique<uring_reactor>(handler, config);
+        if (res->init(listen_d, wake_d)) {
+            return res;
+        }
+        LOG(WARNING) << "io_uring isn't available, fall back to epoll";
+    }
+
+    auto res = std::make_unique<epoll_reactor>(handler, config.edge_triggered);
+    if (res->init(listen_d, wake_d)) {
+        return res;
+    }
+    return nullptr;
+}
@@ -0,0 +1,76 @@
+#ifndef REACTOR_H
+#define REACTOR_H
+
+#include <memory>
+#include <cstdint>
+
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include "server_config.h"
+
+namespace http {
+
+struct connection;
+
+// accepting stops for a while when there are no descriptors left,
+// so the loop doesn't spin on the error of the listening socket
+const int64_t accept_pause_msecs = 100;
+
+// Gets events of a reactor, it's called on the thread of the reactor.
+class reactor_handler
+{
+public:
+    virtual ~reactor_handler() = default;
+
+    // a socket is accepted from the listening socket
+    virtual void handle_accept(int sock_d) noexcept = 0;
+    // the eventfd is signaled
+    virtual void handle_wake() noexcept = 0;
+    // readable, writable or hangup flags of the connection are set
+    virtual void handle_event(connection* conn) noexcept = 0;
+    // the reactor doesn't use the connection anymore and it can be released
+    virtual void handle_closed(connection* conn) noexcept = 0;
+};
+
+// Event loop backend of a worker. Socket operations behave like the ones
+// of a nonblocking socket, so a completion based backend hides submissions
+// behind EAGAIN and reports the completion as the next readiness.
+// It isn't thread safe and belongs to one worker.
+class reactor
+{
+public:
+    virtual ~reactor() = default;
+
+    // listen_d and wake_d are watched if they aren't -1
+    virtual bool init(int listen_d, int wake_d) noexcept = 0;
+
+    // waits for events up to timeout msecs
+    virtual void wait(int timeout_msecs) noexcept = 0;
+    // hands the events got by wait to the handler
+    virtual void dispatch() noexcept = 0;
+
+    // every event is reported once, so a connection with a spent budget
+    // has to be queued by the handler
+    virtual bool edge_triggered() const noexcept = 0;
+
+    virtual bool open(connection* conn) noexcept = 0;
+    // watched events follow the state of the connection
+    virtual bool watch(connection* conn) noexcept = 0;
+    // handle_closed is called when the connection isn't used anymore
+    virtual void close(connection* conn) noexcept = 0;
+
+    virtual ssize_t read(connection* conn, char* buff, size_t size) noexcept = 0;
+    virtual ssize_t send(connection* conn, const iovec* iov, size_t iov_num, bool more) noexcept = 0;
+    virtual ssize_t sendfile(connection* conn, int file_d, off_t offset, size_t size) noexcept = 0;
+};
+
+// returns an initialized reactor of the configured backend, io_uring falls back to epoll
+std::unique_ptr<reactor> make_reactor(const server_config& config,
+                                      reactor_handler* handler,
+                                      int listen_d,
+                                      int wake_d) noexcept;
+
+}
+
+#endif // REACTOR_H
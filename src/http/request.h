@@ -4,8 +4,13 @@
 #include <map>
 #include <string>
 #include <memory>
+#include <string_view>
+#include <type_traits>
 
 #include "buffer.h"
+#include "str.h"
+#include "small_vector.h"
+#include "header_index.h"
 
 namespace http {
 
@@ -14,25 +19,96 @@ enum class request_method
     post,
     get,
     options,
+    head,
     undefined
 };
 
+constexpr std::string_view request_method_to_str(request_method method) noexcept
+{
+    switch (method) {
+    case request_method::get:
+        return "GET";
+    case request_method::post:
+        return "POST";
+    case request_method::options:
+        return "OPTIONS";
+    case request_method::head:
+        return "HEAD";
+    case request_method::undefined:
+        return "";
+    }
+    return "";
+}
+
+// a path segment captured by a router, the value is kept as a range of
+// request::uri, so it stays valid when the request is moved or copied
+struct path_param
+{
+    string name;
+    size_t offset = 0;
+    size_t size = 0;
+};
+
 struct request
 {
     request_method method = request_method::undefined;
     std::string uri;
+    // headers of an outgoing request or a copy made by header_map()
     std::map<std::string,std::string> headers;
+    // received headers point into the receive buffer of the connection,
+    // they're valid until the request handler returns or after header_fields.detach(),
+    // an async handler gets them detached, since it can outlive the connection
+    header_index header_fields;
+    // trailer lines of a chunked body, saved trailer fields point into it
+    std::string trailers;
 
     //
     std::string body_str;
     //
-    std::shared_ptr<buffer> body_buff;
+    buffer body_buff;
     //
     std::string body_file_path;
 
     std::shared_ptr<void> user_data;
+
+    // set by a router: the matched route or -1 and the captured params,
+    // the values aren't decoded, see uri::decode()
+    int route = -1;
+    small_vector<path_param, 4> params;
+    // set by a router when the path has routes but not for the method,
+    // the methods which have them, it's sent as Allow with 405
+    string allow;
+
+    string param_value(const path_param& param) const noexcept
+    {
+        return string(uri.data() + param.offset, param.size);
+    }
+
+    bool find_param(const char* name, string& value) const noexcept
+    {
+        for (auto&& param : params) {
+            if (param.name.compare(name) == 0) {
+                value = param_value(param);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // copies received headers into headers at the first call
+    const std::map<std::string,std::string>& header_map()
+    {
+        if (headers.empty()) {
+            header_fields.copy_to(headers);
+        }
+        return headers;
+    }
 };
 
+static_assert(std::is_nothrow_move_constructible<request>::value
+              && std::is_nothrow_move_assignable<request>::value,
+              "request must be cheap to move");
+
 }
 
 #endif // REQUEST_H
@@ -2,19 +2,19 @@
 
 #include <fcntl.h>
 #include <unistd.h>
-#include <sstream>
 
 #include <glog/logging.h>
 
+#include "header_writer.h"
 #include "../utility/filesystem.h"
 
 using namespace http;
 
-request_reader::request_reader(const request& request,
+request_reader::request_reader(request&& request,
                                const std::string &host,
                                uint16_t port,
                                const std::string &uri) :
-    _req(request)
+    _req(std::move(request))
 {
     if (!_req.body_file_path.empty()) {
         _body_fd = open(_req.body_file_path.data(), O_RDONLY);
@@ -37,24 +37,29 @@ request_reader::request_reader(const request& request,
 //            return;
 
         }
-    } else if (!request.body_str.empty()) {
+    } else if (!_req.body_str.empty()) {
         _body_size = _req.body_str.size();
-    } else if (_req.body_buff != nullptr) {
-        _body_size = _req.body_buff->size();
+    } else if (!_req.body_buff.empty()) {
+        _body_size = _req.body_buff.size();
     }
 
-    std::stringstream ss;
-    ss << request_method_to_str(_req.method) << " " << uri << " HTTP/1.1\r\n";
-    ss << "Host: " << host << ":" << port << "\r\n";
+    header_writer writer(_line);
+    writer.append(request_method_to_str(_req.method));
+    writer.append(" ");
+    writer.append(uri);
+    writer.append(" HTTP/1.1\r\n");
+    writer.append("Host: ");
+    writer.append(host);
+    writer.append(":");
+    writer.append(static_cast<uint64_t>(port));
+    writer.append("\r\n");
     for (auto&& header : _req.headers) {
-        ss << header.first << ": " << header.second << "\r\n";
+        writer.header(header.first, header.second);
     }
     if (_body_size > 0) {
-        ss << "Content-Length: " << _body_size << "\r\n";
+        writer.header("Content-Length", _body_size);
     }
-    ss << "\r\n";
-
-    _line = ss.str();
+    writer.end();
 }
 
 request_reader::~request_reader()
@@ -90,7 +95,7 @@ request_chunk request_reader::get_chunk() const noexcept
         res.size = _body_size - _body_written_size;
         break;
     case state::read_body_buff:
-        res.buff = _req.body_buff->data() + _body_written_size;
+        res.buff = _req.body_buff.data() + _body_written_size;
         res.size = _body_size - _body_written_size;
         break;
     case state::read_none:
@@ -110,7 +115,7 @@ void request_reader::next(size_t size) noexcept
                 _state = state::read_body_file;
             } else if (!_req.body_str.empty()) {
                 _state = state::read_body_str;
-            } else if (_req.body_buff != nullptr) {
+            } else if (!_req.body_buff.empty()) {
                 _state = state::read_body_buff;
             } else {
                 _state = state::read_none;
@@ -129,19 +134,3 @@ void request_reader::next(size_t size) noexcept
         break;
     }
 }
-
-std::string request_reader::request_method_to_str(request_method method) noexcept
-{
-    switch (method) {
-    case request_method::get:
-        return "GET";
-    case request_method::post:
-        return "POST";
-    case request_method::options:
-        return "OPTIONS";
-    case request_method::undefined:
-        return "";
-    }
-
-    return "";
-}
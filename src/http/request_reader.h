@@ -18,10 +18,15 @@ struct request_chunk
 class request_reader
 {
 public:
-    explicit request_reader(const request& request,
+    // the reader owns the moved request while it's written
+    explicit request_reader(request&& request,
                             const std::string &host,
                             uint16_t port,
                             const std::string& uri);
+    request_reader(const request& request,
+                   const std::string &host,
+                   uint16_t port,
+                   const std::string& uri) = delete;
     ~request_reader();
 
     bool has_chunks() const noexcept;
@@ -38,9 +43,6 @@ private:
         read_body_file
     };
 
-private:
-    static std::string request_method_to_str(request_method method) noexcept;
-
 private:
     request _req;
 
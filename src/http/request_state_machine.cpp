@@ -2,27 +2,33 @@
 
 #include <cassert>
 #include <cstring>
+#include <algorithm>
 
-using namespace http;
+#include "scanner.h"
 
-// TODO: create a rejected char list for every state and use it while parsing
+using namespace http;
 
 request_state_machine::request_state_machine(uri_handler uri,
-                                             header_handler header) :
+                                             header_handler header,
+                                             buffer_pool* pool,
+                                             body_handler body,
+                                             size_t body_chunk_size) :
+    _pool(pool),
     _uri_handler(uri),
-    _header_handler(header)
+    _header_handler(header),
+    _body_handler(body),
+    _body_chunk_size(body_chunk_size)
 {
     _request = std::make_shared<request>();
-
-    _buff = new char[max_payload_size];
-    _buff_size = max_payload_size;
 }
 
 request_state_machine::~request_state_machine()
 {
-    if (_buff != nullptr) {
+    if (_buff != nullptr && _buff != _head_buff) {
         delete[] _buff;
     }
+    release_head_buff();
+    release_buff(_next_buff);
 }
 
 request_state_machine::state
@@ -50,12 +56,52 @@ request_state_machine::get_request() const noexcept
     }
 }
 
+bool request_state_machine::keep_alive() const noexcept
+{
+    return _keep_alive;
+}
+
+bool request_state_machine::has_data() const noexcept
+{
+    return _buff_written_size > 0 || _read_state != read_state::read_method;
+}
+
+bool request_state_machine::reading_body() const noexcept
+{
+    return _read_state == read_state::read_body;
+}
+
+void request_state_machine::set_body_token(body_token token) noexcept
+{
+    _body_token = std::move(token);
+}
+
+bool request_state_machine::paused() const noexcept
+{
+    return _paused;
+}
+
+void request_state_machine::resume() noexcept
+{
+    _paused = false;
+}
+
 std::tuple<char *, size_t>
 request_state_machine::prepare_buff() noexcept
 {
     if (_state == state::processing) {
+        // the header buffer is borrowed only while a request is read
+        if (_buff == nullptr) {
+            acquire_head_buff();
+        }
+
         if (_buff_size > _buff_written_size) {
             size_t avaible_size = _buff_size - _buff_written_size;
+            if (_chunked && _read_state == read_state::read_body) {
+                // bytes past the end of a chunked body must fit a spare buffer
+                const uint64_t max_size = _chunked_decoder.data_left() + head_buff_size();
+                avaible_size = static_cast<size_t>(std::min<uint64_t>(avaible_size, max_size));
+            }
             return {_buff + _buff_written_size, avaible_size};
         } else {
             go_final_error(413);
@@ -71,9 +117,6 @@ void request_state_machine::process_buff(size_t size) noexcept
         return;
     }
 
-    // size of a separators like sp, crlf
-    size_t ignore_size = 0;
-
     // start look for the separators from the end
     size_t current_pos = _buff_written_size;
 
@@ -82,52 +125,120 @@ void request_state_machine::process_buff(size_t size) noexcept
     assert(_buff_size >= _buff_written_size);
     assert(_buff_written_size >= _buff_processed_size);
 
-    for (; current_pos < _buff_written_size; ++current_pos) {
-        if (_wait_state == wait_state::wait_sp) {
-            if (_buff[current_pos] == 0x20) {
-                ignore_size = 1;
-                _need_transit = true;
-            }
-        } else if (_wait_state == wait_state::wait_crlf) {
-            if (!_got_cr) {
-                if (_buff[current_pos] == 0x0D) {
-                    _got_cr = true;
-                    continue;
-                }
-            } else {
-                if (_buff[current_pos] == 0x0A) {
-                    ignore_size = 2;
-                    _need_transit = true;
-                } else {
-                    _got_cr = false;
-                }
-            }
-        } else if (_wait_state == wait_state::wait_all) {
-            char* buff = _buff + _buff_processed_size;
-            size_t size = _buff_written_size - _buff_processed_size;
+    if (_wait_state == wait_state::wait_all) {
+        char* buff = _buff + _buff_processed_size;
+        size_t size = _buff_written_size - _buff_processed_size;
 
-            _buff_processed_size += size;
+        _buff_processed_size += size;
 
-            go_next(buff, size);
+        go_next(buff, size);
+        return;
+    }
 
-            break;
-        } else if (_wait_state == wait_state::wait_none) {
+    while (current_pos < _buff_written_size
+           && (_wait_state == wait_state::wait_sp || _wait_state == wait_state::wait_crlf)) {
+        // CR was the last byte of a previous read
+        if (_got_cr) {
+            _got_cr = false;
+            if (_buff[current_pos] != 0x0A) {
+                go_final_error(400);
+                return;
+            }
+            go_transit(current_pos, 2);
+            ++current_pos;
+            continue;
+        }
+
+        const char_table& table = current_table();
+        current_pos += scan(_buff + current_pos, _buff_written_size - current_pos, table);
+        if (current_pos == _buff_written_size) {
             break;
         }
 
-        if (_need_transit) {
-            _got_sp = false;
-            _got_cr = false;
-            _got_lf = false;
-            _need_transit = false;
+        const char ch = _buff[current_pos];
+        if (table.classes[static_cast<uint8_t>(ch)] != char_class::delimiter) {
+            go_final_error(400);
+            return;
+        }
+
+        if (ch == 0x0D) {
+            _got_cr = true;
+            ++current_pos;
+            continue;
+        }
+
+        go_transit(current_pos, 1);
+        ++current_pos;
+    }
+}
+
+void request_state_machine::reset() noexcept
+{
+    // bytes of a next pipelined request
+    size_t leftover_pos = 0;
+    size_t leftover_size = 0;
+
+    if (_buff != _head_buff) {
+        // _buff is a body buffer if it wasn't given to the request
+        if (_buff != nullptr) {
+            delete[] _buff;
+        }
 
-            char* buff = _buff + _buff_processed_size;
-            size_t size = (current_pos + 1) - _buff_processed_size;
+        leftover_pos = _head_leftover_pos;
+        leftover_size = _head_leftover_size;
 
-            _buff_processed_size += size;
+        if (_next_buff != nullptr) {
+            release_head_buff();
+            _head_buff = _next_buff;
+            _next_buff = nullptr;
 
-            go_next(buff, size - ignore_size);
+            leftover_pos = 0;
+            leftover_size = _next_buff_size;
         }
+    } else {
+        leftover_pos = _buff_processed_size;
+        leftover_size = _buff_written_size - _buff_processed_size;
+    }
+
+    if (_state != state::accpeted) {
+        leftover_size = 0;
+    }
+
+    if (leftover_size > 0) {
+        if (leftover_pos > 0) {
+            memmove(_head_buff, _head_buff + leftover_pos, leftover_size);
+        }
+    } else {
+        release_head_buff();
+    }
+
+    _buff = _head_buff;
+    _buff_size = _head_buff != nullptr ? head_buff_size() : 0;
+    _buff_written_size = 0;
+    _buff_processed_size = 0;
+
+    _head_leftover_pos = 0;
+    _head_leftover_size = 0;
+
+    _content_length = 0;
+    _body_left_size = 0;
+    _next_buff_size = 0;
+
+    _chunked = false;
+    _chunked_decoder.reset();
+
+    _paused = false;
+    _got_cr = false;
+    _keep_alive = true;
+    _state = state::processing;
+    _wait_state = wait_state::wait_sp;
+    _read_state = read_state::read_method;
+
+    _rejected_code = 0;
+    _request = std::make_shared<request>();
+
+    if (leftover_size > 0) {
+        process_buff(leftover_size);
     }
 }
 
@@ -181,7 +292,15 @@ std::tuple<bool, int>
 request_state_machine::handle_read_headers(const char *buff, size_t size) noexcept
 {
     auto [key, value] = parse_header(buff, size);
-    if (key.compare("Content-Length") == 0) {
+    if (key.empty()) {
+        return {false, 400};
+    }
+
+    const known_header known = header_index::to_known(key);
+    _request->header_fields.set(known, value);
+
+    switch (known) {
+    case known_header::content_length: {
         bool ok = false;
         int64_t length = value.to_int(ok);
         if (ok && length>=0) {
@@ -190,26 +309,78 @@ request_state_machine::handle_read_headers(const char *buff, size_t size) noexce
         } else {
             return {false, 400};
         }
+    }
+    case known_header::transfer_encoding:
+        // chunked is the only coding of a request body which is supported
+        if (value.compare_nocase("chunked") != 0) {
+            return {false, 501};
+        }
+        if (_chunked) {
+            return {false, 400};
+        }
+        _chunked = true;
+        break;
+    case known_header::connection:
+        if (has_token(value, "close")) {
+            _keep_alive = false;
+        } else if (has_token(value, "keep-alive")) {
+            _keep_alive = true;
+        }
+        break;
+    default:
+        break;
+    }
+
+    int res = -1;
+    if (_header_handler) {
+        res = _header_handler(_request, key, value);
+    }
+
+    if (res == -1) {
+        // the header stays in the receive buffer till the request is handled
+        _request->header_fields.add(key, value);
+        return {true, 0};
+    } else if (res == 0) {
+        return {true, 0};
     } else {
-        if (!key.empty()) {
-            int res = -1;
-            if (_header_handler) {
-                res = _header_handler(_request, key, value);
-            }
+        return {false, res};
+    }
+}
 
-            if (res == -1) {
-                _request->headers.insert({std::string(key.data(), key.size()),
-                                          std::string(value.data(), value.size())});
-                return {true, 0};
-            } else if (res == 0) {
-                return {true, 0};
-            } else {
-                return {false, res};
-            }
-        } else {
+std::tuple<bool, int> request_state_machine::handle_read_trailers() noexcept
+{
+    // the lines are moved to the request, so saved fields outlive the decoder
+    _request->trailers.swap(_chunked_decoder.trailers());
+    const std::string& trailers = _request->trailers;
+
+    size_t pos = 0;
+    while (pos < trailers.size()) {
+        const size_t end = trailers.find("\r\n", pos);
+        auto [key, value] = parse_header(trailers.data() + pos, end - pos);
+        pos = end + 2;
+
+        if (key.empty()) {
             return {false, 400};
         }
+
+        // fields about framing, routing and conditions can't come after the body
+        if (header_index::to_known(key) != known_header::none) {
+            continue;
+        }
+
+        int res = -1;
+        if (_header_handler) {
+            res = _header_handler(_request, key, value);
+        }
+
+        if (res == -1) {
+            _request->header_fields.add(key, value);
+        } else if (res > 0) {
+            return {false, res};
+        }
     }
+
+    return {true, 0};
 }
 
 void request_state_machine::go_next(char *buff, size_t size) noexcept
@@ -257,50 +428,13 @@ void request_state_machine::go_next(char *buff, size_t size) noexcept
             }
         } else {
             switch (_request->method) {
-            case request_method::post: {
-                if (_content_length <= 0) {
-                    go_final_error(411);
-                    return;
-                }
-
-                if (_content_length > max_content_size) {
-                    go_final_error(413);
-                    return;
-                }
-
-                char* new_buff = new char[_content_length];
-                size_t new_buff_size = _content_length;
-                size_t new_buff_written_size = 0;
-
-                // save a part of body if it's in req->buff
-                if (_buff_written_size > _buff_processed_size) {
-                    size_t copy_size = _buff_written_size - _buff_processed_size;
-                    if (copy_size > new_buff_size) {
-                        copy_size = new_buff_size;
-                    }
-                    memcpy(new_buff, _buff + _buff_processed_size, copy_size);
-                    new_buff_written_size += copy_size;
-                }
-
-                delete[] _buff;
-                _buff = new_buff;
-                _buff_size = new_buff_size;
-                _buff_written_size = new_buff_written_size;
-                _buff_processed_size = new_buff_written_size;
-
-                _read_state = read_state::read_body;
-                _wait_state = wait_state::wait_all;
-
-                // after the prev step we can already have written body
-                if (_buff_written_size >= _buff_size) {
-                    go_next(nullptr, 0);
-                }
-
+            case request_method::post:
+                go_read_body();
                 break;
-            }
             case request_method::options:
             case request_method::get:
-                if (_content_length == 0) {
+            case request_method::head:
+                if (_content_length == 0 && !_chunked) {
                     go_final_success();
                 } else {
                     go_final_error(400);
@@ -315,8 +449,28 @@ void request_state_machine::go_next(char *buff, size_t size) noexcept
     }
 
     case read_state::read_body: {
-        if (_buff_written_size >= _buff_size) {
-            _request->body_buff = std::make_shared<buffer>(_buff, _buff_written_size);
+        if (_chunked) {
+            handle_chunked_body(buff, size);
+        } else if (_body_handler) {
+            // the chunk buffer is given to the handler when it's full
+            if (_buff_written_size < _buff_size) {
+                break;
+            }
+            _body_left_size -= _buff_written_size;
+            if (!handle_body_chunk(_buff, _buff_written_size, _body_left_size == 0)) {
+                break;
+            }
+
+            if (_body_left_size == 0) {
+                go_final_success();
+            } else {
+                // reads never go past the body to not take pipelined bytes
+                _buff_size = std::min(_buff_size, _body_left_size);
+                _buff_written_size = 0;
+                _buff_processed_size = 0;
+            }
+        } else if (_buff_written_size >= _buff_size) {
+            _request->body_buff = buffer(_buff, _buff_written_size);
 
             _buff = nullptr;
             _buff_size = 0;
@@ -336,6 +490,254 @@ void request_state_machine::go_next(char *buff, size_t size) noexcept
     }
 }
 
+void request_state_machine::go_read_body() noexcept
+{
+    if (_chunked) {
+        // a request with both lengths can be framed differently by a proxy
+        string length;
+        if (_request->header_fields.get(known_header::content_length, length)) {
+            go_final_error(400);
+            return;
+        }
+
+        go_read_chunked_body();
+        return;
+    }
+
+    if (_content_length <= 0) {
+        go_final_error(411);
+        return;
+    }
+
+    if (_body_handler) {
+        go_stream_body();
+        return;
+    }
+
+    if (_content_length > max_content_size) {
+        go_final_error(413);
+        return;
+    }
+
+    char* new_buff = new char[_content_length];
+    size_t new_buff_size = _content_length;
+    size_t new_buff_written_size = 0;
+
+    // save a part of body if it's in req->buff
+    if (_buff_written_size > _buff_processed_size) {
+        size_t copy_size = _buff_written_size - _buff_processed_size;
+        if (copy_size > new_buff_size) {
+            copy_size = new_buff_size;
+        }
+        memcpy(new_buff, _buff + _buff_processed_size, copy_size);
+        new_buff_written_size += copy_size;
+    }
+
+    // the header buffer is kept for header views and pipelined bytes after the body
+    _head_leftover_pos = _buff_processed_size + new_buff_written_size;
+    _head_leftover_size = _buff_written_size - _head_leftover_pos;
+
+    _buff = new_buff;
+    _buff_size = new_buff_size;
+    _buff_written_size = new_buff_written_size;
+    _buff_processed_size = new_buff_written_size;
+
+    _read_state = read_state::read_body;
+    _wait_state = wait_state::wait_all;
+
+    // after the prev step we can already have written body
+    if (_buff_written_size >= _buff_size) {
+        go_next(nullptr, 0);
+    }
+}
+
+void request_state_machine::go_stream_body() noexcept
+{
+    _body_left_size = _content_length;
+    _read_state = read_state::read_body;
+    _wait_state = wait_state::wait_all;
+
+    // a part of the body read with the headers is given right from the header buffer
+    size_t head_body_size = std::min(_buff_written_size - _buff_processed_size, _body_left_size);
+    if (head_body_size > 0) {
+        const char* head_body = _buff + _buff_processed_size;
+        _buff_processed_size += head_body_size;
+
+        _body_left_size -= head_body_size;
+        if (!handle_body_chunk(head_body, head_body_size, _body_left_size == 0)) {
+            return;
+        }
+    }
+
+    if (_body_left_size == 0) {
+        // reset finds pipelined bytes after the body in the header buffer
+        go_final_success();
+        return;
+    }
+
+    _head_leftover_pos = 0;
+    _head_leftover_size = 0;
+
+    // the rest comes through one chunk buffer, so a body of any size takes
+    // the same memory, and no bytes are read while the handler is busy
+    _buff_size = std::min(_body_chunk_size, _body_left_size);
+    _buff = new char[_buff_size];
+    _buff_written_size = 0;
+    _buff_processed_size = 0;
+}
+
+void request_state_machine::go_read_chunked_body() noexcept
+{
+    _read_state = read_state::read_body;
+    _wait_state = wait_state::wait_all;
+
+    // the bytes read with the headers are decoded in place in the header buffer
+    char* head_body = _buff + _buff_processed_size;
+    size_t consumed = 0;
+    const size_t payload_size = _chunked_decoder.decode(head_body,
+                                                        _buff_written_size - _buff_processed_size,
+                                                        head_body, consumed);
+    _buff_processed_size += consumed;
+
+    const chunked_decoder::status status = _chunked_decoder.get_status();
+    if (status == chunked_decoder::status::error) {
+        go_final_error(400);
+        return;
+    }
+    const bool done = status == chunked_decoder::status::done;
+
+    if (_body_handler) {
+        if ((payload_size > 0 || done) && !handle_body_chunk(head_body, payload_size, done)) {
+            return;
+        }
+    }
+
+    if (done) {
+        if (!_body_handler && payload_size > 0) {
+            _request->body_buff = buffer::copy(head_body, payload_size);
+        } else if (!_body_handler) {
+            _request->body_buff = buffer();
+        }
+
+        // reset finds pipelined bytes after the body in the header buffer
+        go_end_chunked_body();
+        return;
+    }
+
+    _head_leftover_pos = 0;
+    _head_leftover_size = 0;
+
+    // the rest is read into a body buffer and decoded in place, a streamed body
+    // reuses it for every read, otherwise it grows up to max_content_size
+    _buff_size = std::max(_body_chunk_size, payload_size);
+    _buff = new char[_buff_size];
+    _buff_written_size = 0;
+    _buff_processed_size = 0;
+
+    if (!_body_handler) {
+        memcpy(_buff, head_body, payload_size);
+        _buff_written_size = payload_size;
+        _buff_processed_size = payload_size;
+    }
+}
+
+void request_state_machine::go_end_chunked_body() noexcept
+{
+    auto [ok, code] = handle_read_trailers();
+    if (ok) {
+        go_final_success();
+    } else {
+        go_final_error(code);
+    }
+}
+
+void request_state_machine::handle_chunked_body(char *buff, size_t size) noexcept
+{
+    // the payload replaces the framing, so the buffer holds only the payload
+    size_t consumed = 0;
+    const size_t payload_size = _chunked_decoder.decode(buff, size, buff, consumed);
+    const size_t body_size = static_cast<size_t>(buff - _buff) + payload_size;
+
+    const chunked_decoder::status status = _chunked_decoder.get_status();
+    if (status == chunked_decoder::status::error) {
+        go_final_error(400);
+        return;
+    }
+    const bool done = status == chunked_decoder::status::done;
+
+    if (done && consumed < size) {
+        // prepare_buff doesn't read more of them than fits a buffer of the pool
+        _next_buff_size = size - consumed;
+        _next_buff = acquire_buff();
+        memcpy(_next_buff, buff + consumed, _next_buff_size);
+    }
+
+    _buff_written_size = body_size;
+    _buff_processed_size = body_size;
+
+    if (_body_handler) {
+        if ((body_size > 0 || done) && !handle_body_chunk(_buff, body_size, done)) {
+            return;
+        }
+        _buff_written_size = 0;
+        _buff_processed_size = 0;
+    } else if (done) {
+        if (body_size > 0) {
+            _request->body_buff = buffer(_buff, body_size);
+        } else {
+            delete[] _buff;
+            _request->body_buff = buffer();
+        }
+
+        _buff = nullptr;
+        _buff_size = 0;
+        _buff_written_size = 0;
+        _buff_processed_size = 0;
+    } else if (body_size == _buff_size) {
+        if (_buff_size >= max_content_size) {
+            go_final_error(413);
+            return;
+        }
+
+        const size_t new_buff_size = std::min(_buff_size * 2, max_content_size);
+        char* new_buff = new char[new_buff_size];
+        memcpy(new_buff, _buff, body_size);
+        delete[] _buff;
+
+        _buff = new_buff;
+        _buff_size = new_buff_size;
+    }
+
+    if (done) {
+        go_end_chunked_body();
+    }
+}
+
+bool request_state_machine::handle_body_chunk(const char *buff, size_t size, bool last) noexcept
+{
+    int res = _body_handler(_request, string(buff, size), last, _body_token);
+    if (res > 0) {
+        go_final_error(res);
+        return false;
+    }
+
+    // a buffer is given to the handler at most once for each read,
+    // so the pause takes effect before the next read
+    _paused = res == body_pause && !last;
+    return true;
+}
+
+void request_state_machine::go_transit(size_t pos, size_t ignore_size) noexcept
+{
+    // the separator ends at pos
+    char* buff = _buff + _buff_processed_size;
+    size_t size = (pos + 1) - _buff_processed_size;
+
+    _buff_processed_size += size;
+
+    go_next(buff, size - ignore_size);
+}
+
 void request_state_machine::go_final_error(int code) noexcept
 {
     _rejected_code = code;
@@ -349,11 +751,85 @@ void request_state_machine::go_final_success() noexcept
 {
     _rejected_code = 0;
 
+    // the header buffer goes back to the pool before the request is handled,
+    // unless it holds bytes of a pipelined request, then header views of
+    // the request point into it and it's released by reset
+    const bool head_leftover = _buff == _head_buff
+            ? _buff_written_size > _buff_processed_size
+            : _head_leftover_size > 0 && _next_buff == nullptr;
+    if (_head_buff != nullptr && !head_leftover) {
+        _request->header_fields.detach();
+
+        if (_buff == _head_buff) {
+            _buff = nullptr;
+            _buff_size = 0;
+            _buff_written_size = 0;
+            _buff_processed_size = 0;
+        }
+        release_head_buff();
+    }
+
     _state = state::accpeted;
     _wait_state = wait_state::wait_none;
     _read_state = read_state::read_none;
 }
 
+const char_table &request_state_machine::current_table() const noexcept
+{
+    switch (_read_state) {
+    case read_state::read_method:
+    case read_state::read_uri:
+        return word_table;
+    case read_state::read_version:
+        return version_table;
+    case read_state::read_headers:
+    case read_state::read_body:
+    case read_state::read_none:
+        break;
+    }
+    return text_table;
+}
+
+char *request_state_machine::acquire_buff() noexcept
+{
+    if (_pool != nullptr) {
+        return _pool->acquire();
+    }
+    return new char[max_payload_size];
+}
+
+void request_state_machine::release_buff(char *buff) noexcept
+{
+    if (buff == nullptr) {
+        return;
+    }
+
+    if (_pool != nullptr) {
+        _pool->release(buff);
+    } else {
+        delete[] buff;
+    }
+}
+
+void request_state_machine::acquire_head_buff() noexcept
+{
+    _head_buff = acquire_buff();
+
+    _buff = _head_buff;
+    _buff_size = head_buff_size();
+}
+
+void request_state_machine::release_head_buff() noexcept
+{
+    release_buff(_head_buff);
+    _head_buff = nullptr;
+}
+
+size_t request_state_machine::head_buff_size() const noexcept
+{
+    return _pool != nullptr ? _pool->buff_size() : max_payload_size;
+}
+
 request_method
 request_state_machine::str_to_request_method(const char *str,
                                              size_t size) noexcept
@@ -365,6 +841,8 @@ request_state_machine::str_to_request_method(const char *str,
         result = request_method::get;
     } else if (size == 7 && strncmp(str, "OPTIONS", size) == 0) {
         result = request_method::options;
+    } else if (size == 4 && strncmp(str, "HEAD", size) == 0) {
+        result = request_method::head;
     }
     return result;
 }
@@ -384,3 +862,24 @@ request_state_machine::parse_header(const char *buff, size_t size) noexcept
 
     return res;
 }
+
+bool request_state_machine::has_token(string value, const char *token) noexcept
+{
+    while (!value.empty()) {
+        string item;
+        ssize_t pos = value.find(',');
+        if (pos != -1) {
+            item = string(value.data(), static_cast<size_t>(pos));
+            value = string(value.data() + pos + 1, value.size() - static_cast<size_t>(pos) - 1);
+        } else {
+            item = value;
+            value = string();
+        }
+
+        item.trim();
+        if (item.compare_nocase(token) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
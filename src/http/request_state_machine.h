@@ -7,6 +7,9 @@
 #include "string"
 #include "request.h"
 #include "handlers.h"
+#include "buffer_pool.h"
+#include "scanner.h"
+#include "chunked_decoder.h"
 
 namespace http {
 
@@ -20,16 +23,36 @@ public:
         rejected
     };
 
-    request_state_machine(uri_handler uri, header_handler header);
+    // the header buffer is borrowed from the pool if it's set,
+    // a body is streamed by chunks of body_chunk_size if the body handler is set
+    request_state_machine(uri_handler uri,
+                          header_handler header,
+                          buffer_pool* pool = nullptr,
+                          body_handler body = nullptr,
+                          size_t body_chunk_size = 64*1024);
     ~request_state_machine();
 
     state get_state() const noexcept;
     int get_rejected_code() const noexcept;
     std::shared_ptr<request> get_request() const noexcept;
+    bool keep_alive() const noexcept;
+    // any byte of the request is read
+    bool has_data() const noexcept;
+    bool reading_body() const noexcept;
+
+    // given to the body handler, so it can resume the body it has paused
+    void set_body_token(body_token token) noexcept;
+    // the body handler has paused the body, no bytes are read till resume
+    bool paused() const noexcept;
+    void resume() noexcept;
 
     std::tuple<char*,size_t> prepare_buff() noexcept;
     void process_buff(size_t size) noexcept;
 
+    // prepares the state machine for the next request on the same connection,
+    // the bytes read after the end of the current request are processed again
+    void reset() noexcept;
+
 private:
     enum class wait_state
     {
@@ -62,16 +85,40 @@ private:
     inline std::tuple<bool, int>
     handle_read_headers(const char* buff, size_t size) noexcept;
 
+    std::tuple<bool, int> handle_read_trailers() noexcept;
+
+    void go_read_body() noexcept;
+    void go_stream_body() noexcept;
+    void go_read_chunked_body() noexcept;
+    void go_end_chunked_body() noexcept;
+    // decodes the bytes read into _buff at buff
+    void handle_chunked_body(char* buff, size_t size) noexcept;
+    // gives the chunk to the body handler, returns false if the request is rejected
+    bool handle_body_chunk(const char* buff, size_t size, bool last) noexcept;
+
     void go_next(char* buff, size_t size) noexcept;
+    // hands the bytes till pos without the separator to go_next
+    void go_transit(size_t pos, size_t ignore_size) noexcept;
     void go_final_error(int code) noexcept;
     void go_final_success() noexcept;
 
+    // allowed bytes and the separator of the current part
+    const char_table& current_table() const noexcept;
+
+    char* acquire_buff() noexcept;
+    void release_buff(char* buff) noexcept;
+    void acquire_head_buff() noexcept;
+    void release_head_buff() noexcept;
+    size_t head_buff_size() const noexcept;
+
     static request_method
     str_to_request_method(const char* str, size_t size) noexcept;
 
     static std::pair<http::string, http::string>
     parse_header(const char* buff, size_t size) noexcept;
 
+    static bool has_token(string value, const char* token) noexcept;
+
 private:
     const size_t max_payload_size = 2*1024;
     const size_t max_content_size = 10*1024*1024;
@@ -81,12 +128,27 @@ private:
     size_t _buff_written_size = 0;
     size_t _buff_processed_size = 0;
 
+    buffer_pool* _pool = nullptr;
+
+    // _buff points to it while headers are read
+    char* _head_buff = nullptr;
+    size_t _head_leftover_pos = 0;
+    size_t _head_leftover_size = 0;
+
+    // bytes of pipelined requests read past a chunked body, reset moves them to the header buffer
+    char* _next_buff = nullptr;
+    size_t _next_buff_size = 0;
+
     size_t _content_length = 0;
+    // bytes of a streamed body which aren't given to the body handler yet
+    size_t _body_left_size = 0;
+
+    bool _chunked = false;
+    chunked_decoder _chunked_decoder;
 
-    bool _got_sp = false;
+    bool _paused = false;
     bool _got_cr = false;
-    bool _got_lf = false;
-    bool _need_transit = false;
+    bool _keep_alive = true;
     state _state = state::processing;
     wait_state _wait_state = wait_state::wait_sp;
     read_state _read_state = read_state::read_method;
@@ -96,6 +158,9 @@ private:
 
     uri_handler _uri_handler = nullptr;
     header_handler _header_handler = nullptr;
+    body_handler _body_handler = nullptr;
+    body_token _body_token;
+    size_t _body_chunk_size = 0;
 };
 
 }
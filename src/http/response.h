@@ -3,12 +3,21 @@
 
 #include <string>
 #include <memory>
+#include <functional>
+#include <type_traits>
+
+#include <sys/types.h>
 
 #include "buffer.h"
+#include "file_cache.h"
 #include "content_types.h"
 
 namespace http {
 
+// fills buff with a next part of a body and returns its size, 0 if there are
+// no data yet, -1 at the end of the body and other negative values on an error
+typedef std::function<ssize_t(char* buff, size_t size)> body_producer;
+
 struct response
 {
     int code = 0;
@@ -16,12 +25,38 @@ struct response
 
     //
     std::string body_str;
-    //
-    std::shared_ptr<buffer> body_buff;
-    //
+    // shared bytes, e.g. a cached body sent to many clients at once
+    buffer body_buff;
+    // buffers sent one after another, it's used instead of body_buff
+    buffer_chain body_chain;
+    // the file is taken from the file cache, a missing file is sent as 404
     std::string body_file_path;
+    // a file already got from the cache, it's used instead of body_file_path
+    std::shared_ptr<const file_entry> body_file;
+    // the body is produced by parts while the socket is writable, it's sent
+    // with Content-Length if producer_size is set, otherwise by chunked encoding
+    body_producer producer;
+    int64_t producer_size = -1;
+
+    // validators of the body, a quoted ETag and an http date, a file body
+    // gets them from the file cache if they aren't set
+    std::string etag;
+    std::string last_modified;
+
+    // the body is already encoded, e.g. a precompressed file
+    content_encoding encoding = content_encoding::identity;
+    // the body is sent encoded for some Accept-Encoding values, it's sent with Vary
+    bool vary_encoding = false;
+
+    // the methods of the resource, it's sent as Allow, e.g. with 405
+    std::string allow;
 };
 
+// a response is moved from the handler to the reader, its body is never copied on the way
+static_assert(std::is_nothrow_move_constructible<response>::value
+              && std::is_nothrow_move_assignable<response>::value,
+              "response must be cheap to move");
+
 }
 
 #endif // RESPONSE_H
@@ -1,71 +1,327 @@
 #include "response_reader.h"
 
-#include <fcntl.h>
-#include <unistd.h>
-#include <sstream>
+#include <vector>
+#include <random>
+#include <cstring>
+#include <algorithm>
 
-#include "../utility/filesystem.h"
+#include "status_codes.h"
+#include "header_writer.h"
+#include "conditional.h"
 
-http::response_reader::response_reader(const response &resp) :
-    _resp(resp)
+namespace {
+
+// writes size hex digits of a random number, the generator of each thread
+// is seeded once from the system, so boundaries differ between processes
+void random_hex(char* buff, size_t size) noexcept
 {
-    if (!_resp.body_file_path.empty()) {
-        _body_fd = open(_resp.body_file_path.data(), O_RDONLY);
-        if (_body_fd == -1) {
-            // TODO:
-//            perror("open file to write body");
-//            release_connection(conn);
-//            return;
+    static const char digits[] = "0123456789abcdef";
+    thread_local std::mt19937_64 generator(std::random_device{}());
+
+    uint64_t value = 0;
+    for (size_t i=0; i<size; ++i) {
+        if (i % 16 == 0) {
+            value = generator();
         }
+        buff[i] = digits[value & 0xf];
+        value >>= 4;
+    }
+}
 
-        ssize_t size = filesystem::file_size(_body_fd);
-        if (size != -1) {
-            _body_size = static_cast<size_t>(size);
-        } else {
-            // TODO:
-//            perror("get file size");
-//            release_connection(conn);
-//            return;
+}
+
+http::response_reader::response_reader() noexcept
+{
+}
 
+http::response_reader::~response_reader()
+{
+}
+
+void http::response_reader::reset(response &&resp,
+                                  const request* req,
+                                  bool keep_alive,
+                                  const header_cache& headers,
+                                  file_cache& files) noexcept
+{
+    _resp = std::move(resp);
+    _file.reset();
+    _line_written_size = 0;
+    _body_size = 0;
+    _body_written_size = 0;
+    _part_pos = 0;
+    _part_size = 0;
+    _chunked = false;
+    _produced = false;
+    _aborted = false;
+    _state = state::read_line;
+    _body_state = state::read_none;
+    _segments.clear();
+    _segment_index = 0;
+    _segment_written_size = 0;
+    _full_size = 0;
+    _multipart = false;
+
+    if (_resp.producer) {
+        _chunked = _resp.producer_size < 0;
+        _body_size = _chunked ? 0 : static_cast<size_t>(_resp.producer_size);
+    } else if (_resp.body_file || !_resp.body_file_path.empty()) {
+        _file = _resp.body_file ? _resp.body_file : files.open(_resp.body_file_path);
+        if (_file) {
+            _body_size = _file->size;
+        } else {
+            _resp.code = 404;
         }
     } else if (!_resp.body_str.empty()) {
         _body_size = _resp.body_str.size();
-    } else if (_resp.body_buff != nullptr) {
-        _body_size = _resp.body_buff->size();
+    } else if (!_resp.body_chain.empty()) {
+        _body_size = _resp.body_chain.size();
+    } else if (!_resp.body_buff.empty()) {
+        _body_size = _resp.body_buff.size();
+    }
+
+    if (_resp.producer && (_chunked || _body_size > 0)) {
+        _body_state = state::read_body_producer;
+    } else if (_body_size == 0) {
+        _body_state = state::read_none;
+    } else if (_file) {
+        _body_state = state::read_body_file;
+    } else if (!_resp.body_str.empty()) {
+        _body_state = state::read_body_str;
+    } else if (!_resp.body_chain.empty()) {
+        _body_state = state::read_body_segments;
+        add_body_slices(byte_range{0, _body_size});
+    } else if (!_resp.body_buff.empty()) {
+        _body_state = state::read_body_buff;
     }
 
-    std::stringstream ss;
-    ss << "HTTP/1.1 " << _resp.code << " " << status_code_to_str(_resp.code) << "\r\n";
-    ss << "Access-Control-Allow-Origin: *" << "\r\n";
-    if (_body_size > 0) {
-        ss << "Content-Length: " << _body_size << "\r\n";
-        switch(_resp.content_type) {
-        case content_types::none:
-            break;
-        case content_types::text:
-            ss << "Content-Type: text/plain" << "\r\n";
-            break;
-        case content_types::json:
-            ss << "Content-Type: application/json" << "\r\n";
-            break;
-        case content_types::hls_chunk:
-            ss << "Content-Type: video/MP2T" << "\r\n";
-            break;
-        case content_types::hls_playlist:
-            ss << "Content-Type: application/vnd.apple.mpegurl" << "\r\n";
-            break;
+    // a matching validator short-circuits the body and ranges of it
+    if (req != nullptr && _resp.code == 200 && !_resp.producer && is_not_modified(*req)) {
+        _resp.code = 304;
+        _body_size = 0;
+        _body_state = state::read_none;
+    }
+
+    const bool ranged = select_ranges(req);
+
+    content_types content_type = _body_state != state::read_none && !_multipart ? _resp.content_type
+                                                                                : content_types::none;
+
+    header_writer writer(_line);
+    headers.write_block(writer, _resp.code, content_type, keep_alive);
+    if (_file) {
+        writer.header("Accept-Ranges", "bytes");
+    }
+    if (_resp.code == 200 || _resp.code == 206 || _resp.code == 304) {
+        const std::string& etag = body_etag();
+        const std::string& last_modified = body_last_modified();
+        if (!etag.empty()) {
+            writer.header("ETag", etag);
+        }
+        if (!last_modified.empty()) {
+            writer.header("Last-Modified", last_modified);
+        }
+        // caches keep the encodings of the body apart
+        if (_resp.encoding != content_encoding::identity || _resp.vary_encoding) {
+            writer.header("Vary", "Accept-Encoding");
         }
     }
-    ss << "\r\n";
+    if (!_resp.allow.empty()) {
+        writer.header("Allow", _resp.allow);
+    }
+    if (_resp.encoding != content_encoding::identity && _body_state != state::read_none) {
+        writer.header("Content-Encoding", content_encoding_to_str(_resp.encoding));
+    }
+    if (ranged) {
+        if (_multipart) {
+            writer.append("Content-Type: multipart/byteranges; boundary=");
+            writer.append(_boundary);
+            writer.append("\r\n");
+        } else if (_resp.code == 206) {
+            write_range(writer, _ranges[0]);
+        } else {
+            writer.append("Content-Range: bytes */");
+            writer.append(_full_size);
+            writer.append("\r\n");
+        }
+    }
+    // the length or the last chunk delimits the response on a persistent connection
+    if (_chunked) {
+        writer.header("Transfer-Encoding", "chunked");
+    } else if (_body_size > 0 || status_code_has_body(_resp.code)) {
+        writer.header("Content-Length", _body_size);
+    }
+    writer.append(headers.date());
+    writer.end();
 
-    _line = ss.str();
+    // a response to HEAD has the header of GET without the body
+    if (req != nullptr && req->method == request_method::head) {
+        _body_state = state::read_none;
+    }
 }
 
-http::response_reader::~response_reader()
+const std::string &http::response_reader::body_etag() const noexcept
+{
+    return _resp.etag.empty() && _file ? _file->etag : _resp.etag;
+}
+
+const std::string &http::response_reader::body_last_modified() const noexcept
+{
+    return _resp.last_modified.empty() && _file ? _file->last_modified : _resp.last_modified;
+}
+
+bool http::response_reader::is_not_modified(const request &req) const noexcept
+{
+    if (!_resp.etag.empty() || !_resp.last_modified.empty()) {
+        return not_modified(req,
+                            string(_resp.etag.data(), _resp.etag.size()),
+                            string(_resp.last_modified.data(), _resp.last_modified.size()));
+    }
+    if (_file) {
+        return not_modified(req,
+                            string(_file->etag.data(), _file->etag.size()),
+                            string(),
+                            _file->mtime.tv_sec);
+    }
+    return false;
+}
+
+bool http::response_reader::select_ranges(const request *req) noexcept
+{
+    // only a whole body of GET can be sliced
+    if (req == nullptr || req->method != request_method::get || _resp.code != 200
+            || _resp.producer || _body_state == state::read_body_producer) {
+        return false;
+    }
+
+    string value;
+    if (!req->header_fields.get(known_header::range, value)) {
+        return false;
+    }
+
+    // a range of a changed body makes no sense, so the whole one is sent
+    string if_range;
+    if (req->header_fields.get(known_header::if_range, if_range)) {
+        const std::string& etag = body_etag();
+        const std::string& last_modified = body_last_modified();
+        const bool matches = (!etag.empty() && if_range.compare(etag.data()) == 0)
+                || (!last_modified.empty() && if_range.compare(last_modified.data()) == 0);
+        if (!matches) {
+            return false;
+        }
+    }
+
+    _full_size = _body_size;
+    switch (parse_byte_ranges(value, _full_size, _ranges)) {
+    case range_status::none:
+        return false;
+    case range_status::unsatisfiable:
+        _resp.code = 416;
+        _body_size = 0;
+        _body_state = state::read_none;
+        return true;
+    case range_status::satisfiable:
+        break;
+    }
+
+    _resp.code = 206;
+    _body_state = state::read_body_segments;
+    _multipart = _ranges.size() > 1;
+    _segments.clear();
+
+    if (_multipart) {
+        random_hex(_boundary, boundary_size);
+    }
+
+    if (!_multipart) {
+        add_body_slices(_ranges[0]);
+        _body_size = static_cast<size_t>(_ranges[0].size);
+        return true;
+    }
+
+    // the part headers are written at once, so the segments can point into them
+    std::vector<size_t> part_ends;
+    part_ends.reserve(_ranges.size() + 1);
+    header_writer writer(_parts);
+    for (auto&& range : _ranges) {
+        writer.append("\r\n--");
+        writer.append(_boundary);
+        writer.append("\r\n");
+        if (_resp.content_type != content_types::none) {
+            writer.header("Content-Type", content_type_to_str(_resp.content_type));
+        }
+        write_range(writer, range);
+        writer.append("\r\n");
+        part_ends.push_back(_parts.size());
+    }
+    writer.append("\r\n--");
+    writer.append(_boundary);
+    writer.append("--\r\n");
+    part_ends.push_back(_parts.size());
+
+    _body_size = 0;
+    size_t part_begin = 0;
+    for (size_t i=0; i<part_ends.size(); ++i) {
+        response_chunk part;
+        part.buff = _parts.data() + part_begin;
+        part.size = part_ends[i] - part_begin;
+        _segments.push_back(part);
+        _body_size += part.size;
+        part_begin = part_ends[i];
+
+        if (i < _ranges.size()) {
+            add_body_slices(_ranges[i]);
+            _body_size += _ranges[i].size;
+        }
+    }
+    return true;
+}
+
+void http::response_reader::write_range(header_writer &writer, const byte_range &range) const noexcept
 {
-    if (_body_fd != -1) {
-        close(_body_fd);
+    writer.append("Content-Range: bytes ");
+    writer.append(range.offset);
+    writer.append("-");
+    writer.append(range.offset + range.size - 1);
+    writer.append("/");
+    writer.append(_full_size);
+    writer.append("\r\n");
+}
+
+void http::response_reader::add_body_slices(const byte_range &range) noexcept
+{
+    response_chunk res;
+    res.size = static_cast<size_t>(range.size);
+    if (_file) {
+        res.file_d = _file->fd;
+        res.file_offset = static_cast<off_t>(range.offset);
+    } else if (!_resp.body_str.empty()) {
+        res.buff = _resp.body_str.data() + range.offset;
+    } else if (!_resp.body_chain.empty()) {
+        // a range of a chain can span several of its buffers
+        size_t offset = static_cast<size_t>(range.offset);
+        size_t size = static_cast<size_t>(range.size);
+        for (auto&& buff : _resp.body_chain) {
+            if (size == 0) {
+                break;
+            }
+            if (offset >= buff.size()) {
+                offset -= buff.size();
+                continue;
+            }
+
+            response_chunk part;
+            part.buff = buff.data() + offset;
+            part.size = std::min(size, buff.size() - offset);
+            _segments.push_back(part);
+            size -= part.size;
+            offset = 0;
+        }
+        return;
+    } else if (!_resp.body_buff.empty()) {
+        res.buff = _resp.body_buff.data() + range.offset;
     }
+    _segments.push_back(res);
 }
 
 int http::response_reader::resp_code() const noexcept
@@ -90,7 +346,7 @@ http::response_chunk http::response_reader::get_chunk() const noexcept
         }
         break;
     case state::read_body_file:
-        res.file_d = _body_fd;
+        res.file_d = _file->fd;
         res.file_offset = static_cast<off_t>(_body_written_size);
         res.size = _body_size - _body_written_size;
         break;
@@ -99,9 +355,22 @@ http::response_chunk http::response_reader::get_chunk() const noexcept
         res.size = _body_size - _body_written_size;
         break;
     case state::read_body_buff:
-        res.buff = _resp.body_buff->data() + _body_written_size;
+        res.buff = _resp.body_buff.data() + _body_written_size;
         res.size = _body_size - _body_written_size;
         break;
+    case state::read_body_producer:
+        res.buff = _part_buff.get() + _part_pos;
+        res.size = _part_size;
+        break;
+    case state::read_body_segments:
+        res = _segments[_segment_index];
+        if (res.file_d != -1) {
+            res.file_offset += static_cast<off_t>(_segment_written_size);
+        } else {
+            res.buff += _segment_written_size;
+        }
+        res.size -= _segment_written_size;
+        break;
     case state::read_none:
         break;
     }
@@ -111,21 +380,17 @@ http::response_chunk http::response_reader::get_chunk() const noexcept
 
 void http::response_reader::next(size_t size) noexcept
 {
-    switch(_state) {
-    case state::read_line:
-        _line_written_size += size;
+    if (_state == state::read_line) {
+        size_t line_size = std::min(size, _line.size() - _line_written_size);
+        _line_written_size += line_size;
+        size -= line_size;
+
         if (_line_written_size >= _line.size()) {
-            if (!_resp.body_file_path.empty()) {
-                _state = state::read_body_file;
-            } else if (!_resp.body_str.empty()) {
-                _state = state::read_body_str;
-            } else if (_resp.body_buff != nullptr) {
-                _state = state::read_body_buff;
-            } else {
-                _state = state::read_none;
-            }
+            _state = _body_state;
         }
-        break;
+    }
+
+    switch(_state) {
     case state::read_body_file:
     case state::read_body_str:
     case state::read_body_buff:
@@ -134,27 +399,158 @@ void http::response_reader::next(size_t size) noexcept
             _state = state::read_none;
         }
         break;
+    case state::read_body_producer:
+        _part_pos += size;
+        _part_size -= size;
+        if (!_chunked) {
+            _body_written_size += size;
+        }
+        if (_part_size == 0 && _produced) {
+            _state = state::read_none;
+        }
+        break;
+    case state::read_body_segments:
+        while (size > 0 && _segment_index < _segments.size()) {
+            const size_t segment_size = std::min(size, _segments[_segment_index].size - _segment_written_size);
+            _segment_written_size += segment_size;
+            size -= segment_size;
+            if (_segment_written_size >= _segments[_segment_index].size) {
+                ++_segment_index;
+                _segment_written_size = 0;
+            }
+        }
+        if (_segment_index >= _segments.size()) {
+            _state = state::read_none;
+        }
+        break;
+    case state::read_line:
     case state::read_none:
         break;
     }
 }
 
-// TODO: move to http::statues enum
-std::string http::response_reader::status_code_to_str(int code) noexcept
+size_t http::response_reader::get_iovecs(iovec *iov, size_t iov_size) const noexcept
+{
+    size_t res = 0;
+
+    if (_state == state::read_line && res < iov_size) {
+        iov[res].iov_base = const_cast<char*>(_line.data() + _line_written_size);
+        iov[res].iov_len = _line.size() - _line_written_size;
+        ++res;
+    }
+
+    if (_state == state::read_line || _state == _body_state) {
+        const char* body = nullptr;
+        size_t body_size = _body_size - _body_written_size;
+        if (_body_state == state::read_body_str) {
+            body = _resp.body_str.data() + _body_written_size;
+        } else if (_body_state == state::read_body_buff) {
+            body = _resp.body_buff.data() + _body_written_size;
+        } else if (_body_state == state::read_body_producer && _part_size > 0) {
+            body = _part_buff.get() + _part_pos;
+            body_size = _part_size;
+        } else if (_body_state == state::read_body_segments) {
+            // the in-memory segments till a file one go by the same call
+            size_t written_size = _segment_written_size;
+            for (size_t i=_segment_index; i<_segments.size() && res < iov_size; ++i) {
+                if (_segments[i].file_d != -1) {
+                    break;
+                }
+                iov[res].iov_base = const_cast<char*>(_segments[i].buff + written_size);
+                iov[res].iov_len = _segments[i].size - written_size;
+                ++res;
+                written_size = 0;
+            }
+        }
+
+        if (body != nullptr && res < iov_size) {
+            iov[res].iov_base = const_cast<char*>(body);
+            iov[res].iov_len = body_size;
+            ++res;
+        }
+    }
+
+    return res;
+}
+
+bool http::response_reader::has_file_chunk() const noexcept
+{
+    if (_state != state::read_line && _state != _body_state) {
+        return false;
+    }
+    if (_body_state == state::read_body_segments) {
+        return _segments[_segment_index].file_d != -1;
+    }
+    return _body_state == state::read_body_file;
+}
+
+bool http::response_reader::produce() noexcept
 {
-    switch (code) {
-    case 200:
-        return "OK";
-    case 400:
-        return "Bad Request";
-    case 404:
-        return "Not found";
-    case 411:
-        return "Length Required";
-    case 413:
-        return "Payload Too Large";
-    case 500:
-        return "Internal Error";
+    const bool producing = _body_state == state::read_body_producer
+            && (_state == state::read_line || _state == state::read_body_producer);
+    if (!producing || _part_size > 0 || _produced) {
+        return _state != state::read_none;
+    }
+
+    if (!_part_buff) {
+        _part_buff.reset(new char[part_buff_size]);
+    }
+
+    char* payload = _part_buff.get() + part_prefix_size;
+    size_t capacity = part_buff_size - part_prefix_size - part_suffix_size;
+    if (!_chunked) {
+        capacity = std::min(capacity, _body_size - _body_written_size);
+    }
+
+    const ssize_t res = _resp.producer(payload, capacity);
+    if (res == 0) {
+        // the header doesn't wait for the body
+        return _state == state::read_line;
     }
-    return "Unknow";
+
+    if (res > 0) {
+        const size_t size = std::min(static_cast<size_t>(res), capacity);
+        if (_chunked) {
+            // the chunk size is written backwards right before the payload
+            static const char hex[] = "0123456789abcdef";
+            char* begin = payload - 2;
+            begin[0] = '\r';
+            begin[1] = '\n';
+            size_t n = size;
+            do {
+                *--begin = hex[n & 0xF];
+                n >>= 4;
+            } while (n != 0);
+
+            char* end = payload + size;
+            end[0] = '\r';
+            end[1] = '\n';
+
+            _part_pos = static_cast<size_t>(begin - _part_buff.get());
+            _part_size = static_cast<size_t>(end + 2 - begin);
+        } else {
+            _part_pos = part_prefix_size;
+            _part_size = size;
+            _produced = _body_written_size + size >= _body_size;
+        }
+        return true;
+    }
+
+    if (res == -1 && _chunked) {
+        memcpy(_part_buff.get(), "0\r\n\r\n", 5);
+        _part_pos = 0;
+        _part_size = 5;
+        _produced = true;
+        return true;
+    }
+
+    // a body of a known length can't end early, a failed body can't be ended at all
+    _aborted = true;
+    _state = state::read_none;
+    return false;
+}
+
+bool http::response_reader::aborted() const noexcept
+{
+    return _aborted;
 }
@@ -1,7 +1,15 @@
 #ifndef RESPONSE_READER_H
 #define RESPONSE_READER_H
 
+#include <memory>
+
+#include <sys/uio.h>
+
+#include "request.h"
 #include "response.h"
+#include "byte_ranges.h"
+#include "small_vector.h"
+#include "header_cache.h"
 
 namespace http {
 
@@ -18,17 +26,43 @@ struct response_chunk
 class response_reader
 {
 public:
-    explicit response_reader(const response& resp);
+    response_reader() noexcept;
     ~response_reader();
 
+    // prepares the reader for a next response on the same connection,
+    // a file body is taken from the file cache. A Range of the request
+    // turns a whole body into 206 with the requested slices of it.
+    // The reader owns the moved response till the next reset.
+    void reset(response&& resp,
+               const request* req,
+               bool keep_alive,
+               const header_cache& headers,
+               file_cache& files) noexcept;
+    // a copy of the body isn't made behind the caller's back
+    void reset(const response& resp,
+               const request* req,
+               bool keep_alive,
+               const header_cache& headers,
+               file_cache& files) = delete;
+
     int resp_code() const noexcept;
 
     bool has_chunks() const noexcept;
     response_chunk get_chunk() const noexcept;
     void next(size_t size) noexcept;
 
-private:
-    inline static std::string status_code_to_str(int code) noexcept;
+    // fills iov with pending in-memory chunks, the header and a string or buffer body
+    // or the buffers of a chain, so they can be written by one call, next() accepts
+    // a size over several of them
+    size_t get_iovecs(iovec* iov, size_t iov_size) const noexcept;
+    // a file body is pending and is sent by sendfile
+    bool has_file_chunk() const noexcept;
+
+    // takes a next part from the body producer if the previous one is written,
+    // returns false if there is nothing to write till the producer has data
+    bool produce() noexcept;
+    // the producer failed, the connection can only be closed
+    bool aborted() const noexcept;
 
 private:
     enum class state
@@ -37,20 +71,60 @@ private:
         read_line,
         read_body_str,
         read_body_buff,
-        read_body_file
+        read_body_file,
+        read_body_producer,
+        read_body_segments
     };
 
+    // validators of the response or of its file
+    const std::string& body_etag() const noexcept;
+    const std::string& body_last_modified() const noexcept;
+    bool is_not_modified(const request& req) const noexcept;
+    // returns false if the response is sent whole
+    bool select_ranges(const request* req) noexcept;
+    void write_range(header_writer& writer, const byte_range& range) const noexcept;
+    // a range of a file, a string or a buffer is one segment, of a chain it can be several
+    void add_body_slices(const byte_range& range) noexcept;
+
 private:
+    const size_t part_buff_size = 16*1024;
+    // the chunk size in hex and CRLF go before a part and CRLF after it
+    const size_t part_prefix_size = 18;
+    const size_t part_suffix_size = 2;
+    static const size_t boundary_size = 16;
+
     response _resp;
 
     std::string _line;
     size_t _line_written_size = 0;
 
-    int _body_fd = -1;
+    std::shared_ptr<const file_entry> _file;
     size_t _body_size = 0;
     size_t _body_written_size = 0;
 
-    state _state = state::read_line;
+    // a produced part with the chunk framing
+    std::unique_ptr<char[]> _part_buff;
+    size_t _part_pos = 0;
+    size_t _part_size = 0;
+    bool _chunked = false;
+    bool _produced = false;
+    bool _aborted = false;
+
+    // slices of the body and multipart headers between them
+    small_vector<response_chunk, 4> _segments;
+    size_t _segment_index = 0;
+    size_t _segment_written_size = 0;
+    std::string _parts;
+    byte_ranges _ranges;
+    // the whole body size for Content-Range
+    size_t _full_size = 0;
+    bool _multipart = false;
+    // random for each multipart response, so a body can't be made to contain it
+    char _boundary[boundary_size + 1] = {};
+
+    state _state = state::read_none;
+    // the state after the header is written
+    state _body_state = state::read_none;
 };
 
 }
@@ -3,19 +3,21 @@
 #include <cstring>
 #include <cassert>
 
+#include "scanner.h"
+
 using namespace http;
 
-response_state_machine::response_state_machine()
+response_state_machine::response_state_machine(buffer_pool* pool) :
+    _pool(pool)
 {
     _response = std::make_shared<response>();
-
-    _buff = new char[max_payload_size];
-    _buff_size = max_payload_size;
 }
 
 response_state_machine::~response_state_machine()
 {
-    if (_buff != nullptr) {
+    if (_buff_is_head) {
+        release_head_buff(_buff);
+    } else if (_buff != nullptr) {
         delete[] _buff;
     }
 }
@@ -49,6 +51,11 @@ std::tuple<char *, size_t>
 http::response_state_machine::prepare_buff() noexcept
 {
     if (_state == state::processing) {
+        // the header buffer is borrowed only while headers are read
+        if (_buff == nullptr) {
+            acquire_head_buff();
+        }
+
         if (_buff_size > _buff_written_size) {
             size_t avaible_size = _buff_size - _buff_written_size;
             return {_buff + _buff_written_size, avaible_size};
@@ -66,9 +73,6 @@ void http::response_state_machine::process_buff(size_t size) noexcept
         return;
     }
 
-    // size of a separators like sp, crlf
-    size_t ignore_size = 0;
-
     // start look for the separators from the end
     size_t current_pos = _buff_written_size;
 
@@ -77,52 +81,50 @@ void http::response_state_machine::process_buff(size_t size) noexcept
     assert(_buff_size >= _buff_written_size);
     assert(_buff_written_size >= _buff_processed_size);
 
-    for (; current_pos < _buff_written_size; ++current_pos) {
-        if (_wait_state == wait_state::wait_sp) {
-            if (_buff[current_pos] == 0x20) {
-                ignore_size = 1;
-                _need_transit = true;
-            }
-        } else if (_wait_state == wait_state::wait_crlf) {
-            if (!_got_cr) {
-                if (_buff[current_pos] == 0x0D) {
-                    _got_cr = true;
-                    continue;
-                }
-            } else {
-                if (_buff[current_pos] == 0x0A) {
-                    ignore_size = 2;
-                    _need_transit = true;
-                } else {
-                    _got_cr = false;
-                }
-            }
-        } else if (_wait_state == wait_state::wait_all) {
-            char* buff = _buff + _buff_processed_size;
-            size_t size = _buff_written_size - _buff_processed_size;
-
-            _buff_processed_size += size;
+    if (_wait_state == wait_state::wait_all) {
+        char* buff = _buff + _buff_processed_size;
+        size_t size = _buff_written_size - _buff_processed_size;
 
-            go_next(buff, size);
+        _buff_processed_size += size;
 
-            break;
-        } else if (_wait_state == wait_state::wait_none) {
-            break;
-        }
+        go_next(buff, size);
+        return;
+    }
 
-        if (_need_transit) {
-            _got_sp = false;
+    while (current_pos < _buff_written_size
+           && (_wait_state == wait_state::wait_sp || _wait_state == wait_state::wait_crlf)) {
+        // CR was the last byte of a previous read
+        if (_got_cr) {
             _got_cr = false;
-            _got_lf = false;
-            _need_transit = false;
+            if (_buff[current_pos] != 0x0A) {
+                go_final_error(400);
+                return;
+            }
+            go_transit(current_pos, 2);
+            ++current_pos;
+            continue;
+        }
 
-            char* buff = _buff + _buff_processed_size;
-            size_t size = (current_pos + 1) - _buff_processed_size;
+        const char_table& table = current_table();
+        current_pos += scan(_buff + current_pos, _buff_written_size - current_pos, table);
+        if (current_pos == _buff_written_size) {
+            break;
+        }
 
-            _buff_processed_size += size;
+        const char ch = _buff[current_pos];
+        if (table.classes[static_cast<uint8_t>(ch)] != char_class::delimiter) {
+            go_final_error(400);
+            return;
+        }
 
-            go_next(buff, size - ignore_size);
+        if (ch == 0x0D) {
+            _got_cr = true;
+            ++current_pos;
+            continue;
         }
+
+        go_transit(current_pos, 1);
+        ++current_pos;
     }
 }
 
@@ -242,7 +244,8 @@ void response_state_machine::go_next(char *buff, size_t size) noexcept
                     new_buff_written_size += copy_size;
                 }
 
-                delete[] _buff;
+                release_head_buff(_buff);
+                _buff_is_head = false;
                 _buff = new_buff;
                 _buff_size = new_buff_size;
                 _buff_written_size = new_buff_written_size;
@@ -264,7 +267,7 @@ void response_state_machine::go_next(char *buff, size_t size) noexcept
 
     case read_state::read_body: {
         if (_buff_written_size >= _buff_size) {
-            _response->body_buff = std::make_shared<buffer>(_buff, _buff_written_size);
+            _response->body_buff = buffer(_buff, _buff_written_size);
 
             _buff = nullptr;
             _buff_size = 0;
@@ -284,6 +287,17 @@ void response_state_machine::go_next(char *buff, size_t size) noexcept
     }
 }
 
+void response_state_machine::go_transit(size_t pos, size_t ignore_size) noexcept
+{
+    // the separator ends at pos
+    char* buff = _buff + _buff_processed_size;
+    size_t size = (pos + 1) - _buff_processed_size;
+
+    _buff_processed_size += size;
+
+    go_next(buff, size - ignore_size);
+}
+
 void response_state_machine::go_final_error(int code) noexcept
 {
     _rejected_code = code;
@@ -295,6 +309,16 @@ void response_state_machine::go_final_error(int code) noexcept
 
 void response_state_machine::go_final_success() noexcept
 {
+    if (_buff_is_head) {
+        release_head_buff(_buff);
+
+        _buff = nullptr;
+        _buff_size = 0;
+        _buff_written_size = 0;
+        _buff_processed_size = 0;
+        _buff_is_head = false;
+    }
+
     _rejected_code = 0;
 
     _state = state::accpeted;
@@ -302,6 +326,43 @@ void response_state_machine::go_final_success() noexcept
     _read_state = read_state::read_none;
 }
 
+const char_table &response_state_machine::current_table() const noexcept
+{
+    switch (_read_state) {
+    case read_state::read_version:
+        return word_table;
+    case read_state::read_status:
+        return digits_table;
+    case read_state::read_status_description:
+    case read_state::read_headers:
+    case read_state::read_body:
+    case read_state::read_none:
+        break;
+    }
+    return text_table;
+}
+
+void response_state_machine::acquire_head_buff() noexcept
+{
+    if (_pool != nullptr) {
+        _buff = _pool->acquire();
+        _buff_size = _pool->buff_size();
+    } else {
+        _buff = new char[max_payload_size];
+        _buff_size = max_payload_size;
+    }
+    _buff_is_head = true;
+}
+
+void response_state_machine::release_head_buff(char *buff) noexcept
+{
+    if (_pool != nullptr) {
+        _pool->release(buff);
+    } else {
+        delete[] buff;
+    }
+}
+
 std::pair<string, string>
 response_state_machine::parse_header(const char *buff, size_t size) noexcept
 {
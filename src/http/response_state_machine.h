@@ -6,6 +6,8 @@
 
 #include "str.h"
 #include "response.h"
+#include "buffer_pool.h"
+#include "scanner.h"
 
 namespace http {
 
@@ -19,7 +21,8 @@ public:
         rejected
     };
 
-    response_state_machine();
+    // the header buffer is borrowed from the pool if it's set
+    explicit response_state_machine(buffer_pool* pool = nullptr);
     ~response_state_machine();
 
     state get_state() const noexcept;
@@ -62,9 +65,17 @@ private:
     handle_read_headers(const char* buff, size_t size) noexcept;
 
     void go_next(char* buff, size_t size) noexcept;
+    // hands the bytes till pos without the separator to go_next
+    void go_transit(size_t pos, size_t ignore_size) noexcept;
     void go_final_error(int code) noexcept;
     void go_final_success() noexcept;
 
+    // allowed bytes and the separator of the current part
+    const char_table& current_table() const noexcept;
+
+    void acquire_head_buff() noexcept;
+    void release_head_buff(char* buff) noexcept;
+
     static std::pair<http::string, http::string>
     parse_header(const char* buff, size_t size) noexcept;
 
@@ -72,17 +83,17 @@ private:
     const size_t max_payload_size = 2*1024;
     const size_t max_content_size = 10*1024*1024;
 
+    buffer_pool* _pool = nullptr;
+
     char* _buff = nullptr;
     size_t _buff_size = 0;
+    bool _buff_is_head = false;
     size_t _buff_written_size = 0;
     size_t _buff_processed_size = 0;
 
     size_t _content_length = 0;
 
-    bool _got_sp = false;
     bool _got_cr = false;
-    bool _got_lf = false;
-    bool _need_transit = false;
     state _state = state::processing;
     wait_state _wait_state = wait_state::wait_sp;
     read_state _read_state = read_state::read_version;
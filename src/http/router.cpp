@@ -0,0 +1,321 @@
+#include "router.h"
+
+#include <iterator>
+#include <algorithm>
+#include <string_view>
+
+#include <glog/logging.h>
+
+using namespace http;
+
+namespace {
+
+std::string_view to_view(string str) noexcept
+{
+    return std::string_view(str.data(), str.size());
+}
+
+}
+
+router::node::node() noexcept
+{
+    std::fill(std::begin(routes), std::end(routes), -1);
+}
+
+unsigned router::node::methods() const noexcept
+{
+    unsigned res = 0;
+    for (size_t i=0; i<methods_num; ++i) {
+        if (route(i) != -1) {
+            res |= 1u << i;
+        }
+    }
+    return res;
+}
+
+int router::node::route(size_t method) const noexcept
+{
+    if (method >= methods_num) {
+        return -1;
+    }
+
+    const size_t head = static_cast<size_t>(request_method::head);
+    const size_t get = static_cast<size_t>(request_method::get);
+    if (method == head && routes[head] == -1) {
+        return routes[get];
+    }
+    return routes[method];
+}
+
+router::router() noexcept
+{
+    for (unsigned methods=1; methods<std::size(_allow); ++methods) {
+        for (size_t i=0; i<methods_num; ++i) {
+            if ((methods & (1u << i)) == 0) {
+                continue;
+            }
+            if (!_allow[methods].empty()) {
+                _allow[methods] += ", ";
+            }
+            _allow[methods] += request_method_to_str(static_cast<request_method>(i));
+        }
+    }
+}
+
+bool router::add(request_method method, const std::string &pattern, request_handler handl)
+{
+    return add(method, pattern, route_handler{handl, nullptr});
+}
+
+bool router::add(request_method method, const std::string &pattern, async_request_handler handl)
+{
+    _has_async_routes = true;
+    return add(method, pattern, route_handler{nullptr, handl});
+}
+
+bool router::add(request_method method, const std::string &pattern, route_handler &&handl)
+{
+    if (method == request_method::undefined) {
+        return false;
+    }
+
+    node* n = insert(pattern);
+    if (n == nullptr) {
+        LOG(ERROR) << "malformed route pattern " << pattern;
+        return false;
+    }
+
+    int& route = n->routes[static_cast<size_t>(method)];
+    if (route != -1) {
+        LOG(ERROR) << "route " << request_method_to_str(method) << " " << pattern << " is already added";
+        return false;
+    }
+
+    route = static_cast<int>(_routes.size());
+    _routes.push_back(std::move(handl));
+    return true;
+}
+
+router::node *router::insert(const std::string &pattern)
+{
+    node* n = &_root;
+
+    // empty segments are skipped like uri does
+    size_t pos = 0;
+    while (pos < pattern.size()) {
+        if (pattern[pos] == '/') {
+            ++pos;
+            continue;
+        }
+
+        size_t end = pattern.find('/', pos);
+        if (end == std::string::npos) {
+            end = pattern.size();
+        }
+        const std::string segment = pattern.substr(pos, end - pos);
+
+        if (segment == "*") {
+            // the wildcard takes the rest, so it's the last segment
+            if (end != pattern.size()) {
+                return nullptr;
+            }
+            if (!n->wildcard_child) {
+                n->wildcard_child = std::make_unique<node>();
+                n->wildcard_child->param_name = "*";
+            }
+            return n->wildcard_child.get();
+        }
+
+        if (segment.front() == '{') {
+            if (segment.size() < 3 || segment.back() != '}') {
+                return nullptr;
+            }
+
+            const std::string name = segment.substr(1, segment.size() - 2);
+            if (!n->param_child) {
+                n->param_child = std::make_unique<node>();
+                n->param_child->param_name = name;
+            } else if (n->param_child->param_name != name) {
+                // one segment can't be captured under different names
+                return nullptr;
+            }
+            n = n->param_child.get();
+        } else {
+            auto it = std::lower_bound(n->children.begin(), n->children.end(), segment,
+                                       [](const std::unique_ptr<node>& child, const std::string& segment) {
+                return child->segment < segment;
+            });
+            if (it == n->children.end() || (*it)->segment != segment) {
+                auto child = std::make_unique<node>();
+                child->segment = segment;
+                it = n->children.insert(it, std::move(child));
+            }
+            n = it->get();
+        }
+
+        pos = end;
+    }
+    return n;
+}
+
+int router::route(const std::shared_ptr<request> &req, string path) const noexcept
+{
+    req->route = -1;
+    req->params.clear();
+    req->allow = string();
+
+    // an unknown method gets 405 on a found path too
+    const size_t method = static_cast<size_t>(req->method);
+
+    unsigned allowed = 0;
+    const int route = match(&_root, path.data(), path.size(), method, *req, allowed);
+    if (route == -1) {
+        req->params.clear();
+        if (allowed == 0) {
+            return 404;
+        }
+        req->allow = string(_allow[allowed].data(), _allow[allowed].size());
+        return 405;
+    }
+
+    req->route = route;
+    return 0;
+}
+
+bool router::has_async_routes() const noexcept
+{
+    return _has_async_routes;
+}
+
+uri_handler router::get_uri_handler(uri_handler next) const
+{
+    return [this, next](std::shared_ptr<request> req, uri u) -> int {
+        // the params are ranges of the uri of the request, so it's saved first
+        req->uri = u.to_str();
+        const string path = u.get_path();
+        const size_t offset = static_cast<size_t>(path.data() - u.data());
+
+        // an unknown path or method is answered by the request handler,
+        // so the connection stays open
+        if (route(req, string(req->uri.data() + offset, path.size())) != 0) {
+            return 0;
+        }
+
+        const int res = next ? next(req, u) : 0;
+        // the uri is already saved
+        return res == -1 ? 0 : res;
+    };
+}
+
+request_handler router::get_request_handler() const
+{
+    return [this](std::shared_ptr<request> req) -> response {
+        if (req->route == -1) {
+            return not_routed(*req);
+        }
+
+        auto&& handl = _routes[req->route];
+        if (handl.sync) {
+            return handl.sync(req);
+        }
+
+        // an async route needs an async server
+        response resp;
+        resp.code = 500;
+        return resp;
+    };
+}
+
+async_request_handler router::get_async_request_handler() const
+{
+    return [this](std::shared_ptr<request> req, completion_token token) {
+        if (req->route == -1) {
+            token.complete(not_routed(*req));
+            return;
+        }
+
+        auto&& handl = _routes[req->route];
+        if (handl.async) {
+            handl.async(req, token);
+        } else {
+            token.complete(handl.sync(req));
+        }
+    };
+}
+
+response router::not_routed(const request &req)
+{
+    response resp;
+    if (req.allow.empty()) {
+        resp.code = 404;
+    } else {
+        resp.code = 405;
+        resp.allow = req.allow.to_str();
+    }
+    return resp;
+}
+
+int router::match(const node *n, const char *path, size_t size, size_t method,
+                  request &req, unsigned &allowed) const noexcept
+{
+    size_t pos = 0;
+    while (pos < size && path[pos] == '/') {
+        ++pos;
+    }
+
+    if (pos == size) {
+        allowed |= n->methods();
+        return n->route(method);
+    }
+
+    size_t end = pos;
+    while (end < size && path[end] != '/') {
+        ++end;
+    }
+    const string segment(path + pos, end - pos);
+
+    // static segments go first, then a capture, then a wildcard
+    if (const node* child = find_child(n, segment)) {
+        const int route = match(child, path + end, size - end, method, req, allowed);
+        if (route != -1) {
+            return route;
+        }
+    }
+
+    if (const node* child = n->param_child.get()) {
+        const string name(child->param_name.data(), child->param_name.size());
+        req.params.push_back({name, static_cast<size_t>(path + pos - req.uri.data()), end - pos});
+
+        const int route = match(child, path + end, size - end, method, req, allowed);
+        if (route != -1) {
+            return route;
+        }
+        req.params.pop_back();
+    }
+
+    if (const node* child = n->wildcard_child.get()) {
+        allowed |= child->methods();
+        const int route = child->route(method);
+        if (route != -1) {
+            req.params.push_back({string(child->param_name.data(), child->param_name.size()),
+                                  static_cast<size_t>(path + pos - req.uri.data()), size - pos});
+            return route;
+        }
+    }
+
+    return -1;
+}
+
+const router::node *router::find_child(const node *n, string segment) noexcept
+{
+    const std::string_view key = to_view(segment);
+
+    auto it = std::lower_bound(n->children.begin(), n->children.end(), key,
+                               [](const std::unique_ptr<node>& child, std::string_view key) {
+        return std::string_view(child->segment) < key;
+    });
+    if (it != n->children.end() && std::string_view((*it)->segment) == key) {
+        return it->get();
+    }
+    return nullptr;
+}
@@ -0,0 +1,97 @@
+#ifndef ROUTER_H
+#define ROUTER_H
+
+#include <string>
+#include <vector>
+#include <memory>
+
+#include "uri.h"
+#include "request.h"
+#include "handlers.h"
+
+namespace http {
+
+// Trie of path segments compiled from route patterns. A pattern is a path of
+// static segments, {name} segments which capture one segment and a final *
+// which captures the rest of the path. Static segments win over captures.
+//
+// The router is matched once by its uri handler: the route and the captured
+// params are saved into the request, so the handler is found without lookups.
+// The uri is saved into the request once as it's done without a router,
+// the params are ranges of it.
+// Routes are added before the server starts, the router must outlive it.
+class router
+{
+public:
+    router() noexcept;
+
+    router(const router&) = delete;
+    router& operator=(const router&) = delete;
+
+    // returns false if the pattern is malformed or the route is already added
+    bool add(request_method method, const std::string& pattern, request_handler handl);
+    // e.g. a handler offloaded by server::offload()
+    bool add(request_method method, const std::string& pattern, async_request_handler handl);
+
+    // saves the matched route into the request, the path is a part of request::uri,
+    // returns 0, 404 or 405 with request::allow set
+    int route(const std::shared_ptr<request>& req, string path) const noexcept;
+
+    bool has_async_routes() const noexcept;
+
+    // routes every request then calls the next uri handler if a route is found,
+    // requests without a route get 404 or 405 from the request handlers
+    uri_handler get_uri_handler(uri_handler next = nullptr) const;
+    request_handler get_request_handler() const;
+    async_request_handler get_async_request_handler() const;
+
+private:
+    static const size_t methods_num = static_cast<size_t>(request_method::undefined);
+
+    struct route_handler
+    {
+        request_handler sync;
+        async_request_handler async;
+    };
+
+    struct node
+    {
+        node() noexcept;
+
+        std::string segment;
+        // static children sorted by segments
+        std::vector<std::unique_ptr<node>> children;
+        std::unique_ptr<node> param_child;
+        std::string param_name;
+        std::unique_ptr<node> wildcard_child;
+
+        // route index per method or -1
+        int routes[methods_num];
+
+        // a bit per method which has a route
+        unsigned methods() const noexcept;
+        // HEAD goes to the GET route if it has no own route
+        int route(size_t method) const noexcept;
+    };
+
+    bool add(request_method method, const std::string& pattern, route_handler&& handl);
+    node* insert(const std::string& pattern);
+
+    // 404 or 405 with Allow for a request without a route
+    static response not_routed(const request& req);
+
+    int match(const node* n, const char* path, size_t size, size_t method,
+              request& req, unsigned& allowed) const noexcept;
+    static const node* find_child(const node* n, string segment) noexcept;
+
+private:
+    node _root;
+    std::vector<route_handler> _routes;
+    // Allow values per set of methods
+    std::string _allow[1 << methods_num];
+    bool _has_async_routes = false;
+};
+
+}
+
+#endif // ROUTER_H
@@ -0,0 +1,114 @@
+#include "scanner.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SCANNER_X86
+#endif
+
+using namespace http;
+
+namespace {
+
+using scan_func = size_t (*)(const char*, size_t, const char_table&) noexcept;
+
+size_t scan_scalar(const char* buff, size_t size, const char_table& table) noexcept
+{
+    for (size_t i=0; i<size; ++i) {
+        if (table.classes[static_cast<uint8_t>(buff[i])] != char_class::regular) {
+            return i;
+        }
+    }
+    return size;
+}
+
+// bits of mask are bytes which stopped the vector scan, a stop byte can still be regular
+inline bool find_in_mask(const char* buff, size_t pos, uint32_t mask,
+                         const char_table& table, size_t& res) noexcept
+{
+    while (mask != 0) {
+        const size_t i = pos + static_cast<size_t>(__builtin_ctz(mask));
+        if (table.classes[static_cast<uint8_t>(buff[i])] != char_class::regular) {
+            res = i;
+            return true;
+        }
+        mask &= mask - 1;
+    }
+    return false;
+}
+
+#ifdef SCANNER_X86
+
+size_t scan_sse2(const char* buff, size_t size, const char_table& table) noexcept
+{
+    const __m128i lo = _mm_set1_epi8(static_cast<char>(table.lo));
+    const __m128i hi = _mm_set1_epi8(static_cast<char>(table.hi));
+    const __m128i del = _mm_set1_epi8(0x7F);
+
+    size_t pos = 0;
+    for (; pos + 16 <= size; pos += 16) {
+        const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(buff + pos));
+
+        // unsigned lo <= x <= hi
+        const __m128i in_range = _mm_and_si128(_mm_cmpeq_epi8(_mm_max_epu8(x, lo), x),
+                                               _mm_cmpeq_epi8(_mm_min_epu8(x, hi), x));
+        const __m128i regular = _mm_andnot_si128(_mm_cmpeq_epi8(x, del), in_range);
+
+        const uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(regular)) ^ 0xFFFFu;
+        size_t res = 0;
+        if (mask != 0 && find_in_mask(buff, pos, mask, table, res)) {
+            return res;
+        }
+    }
+
+    return pos + scan_scalar(buff + pos, size - pos, table);
+}
+
+__attribute__((target("avx2")))
+size_t scan_avx2(const char* buff, size_t size, const char_table& table) noexcept
+{
+    const __m256i lo = _mm256_set1_epi8(static_cast<char>(table.lo));
+    const __m256i hi = _mm256_set1_epi8(static_cast<char>(table.hi));
+    const __m256i del = _mm256_set1_epi8(0x7F);
+
+    size_t pos = 0;
+    for (; pos + 32 <= size; pos += 32) {
+        const __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(buff + pos));
+
+        const __m256i in_range = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_max_epu8(x, lo), x),
+                                                  _mm256_cmpeq_epi8(_mm256_min_epu8(x, hi), x));
+        const __m256i regular = _mm256_andnot_si256(_mm256_cmpeq_epi8(x, del), in_range);
+
+        const uint32_t mask = ~static_cast<uint32_t>(_mm256_movemask_epi8(regular));
+        size_t res = 0;
+        if (mask != 0 && find_in_mask(buff, pos, mask, table, res)) {
+            return res;
+        }
+    }
+
+    return pos + scan_sse2(buff + pos, size - pos, table);
+}
+
+#endif
+
+scan_func select_scan() noexcept
+{
+#ifdef SCANNER_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return scan_avx2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return scan_sse2;
+    }
+#endif
+    return scan_scalar;
+}
+
+const scan_func scan_impl = select_scan();
+
+}
+
+size_t http::scan(const char *buff, size_t size, const char_table &table) noexcept
+{
+    return scan_impl(buff, size, table);
+}
@@ -0,0 +1,64 @@
+#ifndef SCANNER_H
+#define SCANNER_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace http {
+
+enum class char_class : uint8_t
+{
+    regular,
+    delimiter,
+    illegal
+};
+
+// Classes of bytes in one parse state. Bytes in [lo, hi] are regular and are
+// skipped 16 or 32 at once, other bytes and DEL stop the vector scan and are
+// looked up in classes, so classes may only mark bytes out of the range as regular.
+struct char_table
+{
+    uint8_t lo = 0;
+    uint8_t hi = 0;
+    char_class classes[256] = {};
+};
+
+constexpr char_table make_char_table(uint8_t lo, uint8_t hi, char delimiter,
+                                     bool tab = false, bool obs_text = false) noexcept
+{
+    char_table table;
+    table.lo = lo;
+    table.hi = hi;
+
+    for (size_t i=0; i<256; ++i) {
+        if (i >= lo && i <= hi && i != 0x7F) {
+            table.classes[i] = char_class::regular;
+        } else if (i == 0x09 && tab) {
+            table.classes[i] = char_class::regular;
+        } else if (i >= 0x80 && obs_text) {
+            table.classes[i] = char_class::regular;
+        } else {
+            table.classes[i] = char_class::illegal;
+        }
+    }
+    table.classes[static_cast<uint8_t>(delimiter)] = char_class::delimiter;
+
+    return table;
+}
+
+// a method, a request target or a response version ended by SP
+inline constexpr char_table word_table = make_char_table(0x21, 0x7E, ' ');
+// a request version ended by CR
+inline constexpr char_table version_table = make_char_table(0x21, 0x7E, '\r');
+// a status code ended by SP
+inline constexpr char_table digits_table = make_char_table('0', '9', ' ');
+// a header line or a reason phrase ended by CR, it can have SP, HTAB and obs-text
+inline constexpr char_table text_table = make_char_table(0x20, 0xFF, '\r', true, true);
+
+// returns the position of the first byte which isn't regular or size,
+// it uses AVX2 or SSE2 if the CPU has them
+size_t scan(const char* buff, size_t size, const char_table& table) noexcept;
+
+}
+
+#endif // SCANNER_H
@@ -3,17 +3,20 @@
 #include <error.h>
 #include <arpa/inet.h>
 #include <netinet/in.h>
-#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <poll.h>
 
 #include <vector>
 #include <thread>
+#include <algorithm>
 
 #include <glog/logging.h>
 
 #include "worker.h"
-#include "request_state_machine.h"
+#include "../utility/datetime.h"
 
 using namespace http;
 
@@ -33,17 +36,98 @@ bool server::start(const std::string &host,
                    uri_handler uri_hand,
                    header_handler header_hand) noexcept
 {
-    if (!init(host, port)) {
-        uninit();
-        return false;
-    }
+    return start(host, port, request_handl, uri_hand, header_hand, server_config());
+}
+
+bool server::start(const std::string &host,
+                   uint16_t port,
+                   request_handler request_handl,
+                   uri_handler uri_hand,
+                   header_handler header_hand,
+                   const server_config &config) noexcept
+{
+    return start(host, port, request_handl, uri_hand, header_hand, nullptr, config);
+}
 
+bool server::start(const std::string &host,
+                   uint16_t port,
+                   request_handler request_handl,
+                   uri_handler uri_hand,
+                   header_handler header_hand,
+                   body_handler body_handl,
+                   const server_config &config) noexcept
+{
     _request_handler = request_handl;
+    _async_request_handler = nullptr;
+    _uri_handler = uri_hand;
+    _header_handler = header_hand;
+    _body_handler = body_handl;
+
+    return start(host, port, config);
+}
+
+bool server::start(const std::string &host,
+                   uint16_t port,
+                   async_request_handler request_handl,
+                   uri_handler uri_hand,
+                   header_handler header_hand,
+                   body_handler body_handl,
+                   const server_config &config) noexcept
+{
+    _request_handler = nullptr;
+    _async_request_handler = request_handl;
     _uri_handler = uri_hand;
     _header_handler = header_hand;
+    _body_handler = body_handl;
 
-    _isRunning.store(true);
-    _thread = std::thread(&server::loop, this);
+    return start(host, port, config);
+}
+
+bool server::start(const std::string &host,
+                   uint16_t port,
+                   const router &routes,
+                   uri_handler uri_hand,
+                   header_handler header_hand,
+                   body_handler body_handl,
+                   const server_config &config) noexcept
+{
+    // sync routes don't need the async path
+    if (routes.has_async_routes()) {
+        return start(host, port, routes.get_async_request_handler(), routes.get_uri_handler(uri_hand),
+                     header_hand, body_handl, config);
+    }
+    return start(host, port, routes.get_request_handler(), routes.get_uri_handler(uri_hand),
+                 header_hand, body_handl, config);
+}
+
+bool server::start(const std::string &host, uint16_t port, const server_config &config) noexcept
+{
+    _config = config;
+    if (_config.workers_num == 0) {
+        _config.workers_num = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+    _executor.reopen();
+    _executor.set_threads_num(_config.executor_threads_num);
+    _files.set_limits(_config.file_cache_size, _config.file_cache_ttl);
+
+    compression_config compression;
+    compression.enabled = _config.compression;
+    compression.min_size = _config.compression_min_size;
+    compression.offload_size = _config.compression_offload_size;
+    compression.cache_size = _config.compression_cache_size;
+    compression.level = _config.compression_level;
+    // the workers and the executor are stopped, so nothing is encoded meanwhile
+    _compressor.set_config(compression);
+
+    if (!init(host, port)) {
+        uninit();
+        return false;
+    }
+
+    if (!_config.reuse_port) {
+        _isRunning.store(true);
+        _thread = std::thread(&server::loop, this);
+    }
 
     return true;
 }
@@ -52,55 +136,79 @@ void server::stop() noexcept
 {
     _isRunning.store(false);
     if (_thread.joinable()) {
+        uint64_t value = 1;
+        if (write(_wake_d, &value, sizeof(value)) == -1) {
+            perror("write eventfd");
+        }
         _thread.join();
     }
 
     uninit();
+    // the workers are stopped, so nothing is posted anymore
+    _executor.stop();
 }
 
-bool server::init(const std::string &host, uint16_t port) noexcept
+async_request_handler server::offload(request_handler request_handl) noexcept
 {
-    _sd = socket(AF_INET, SOCK_STREAM, 0);
-    if (_sd == -1) {
-        perror("socket");
-        return false;
+    return http::offload(_executor, request_handl);
+}
+
+std::vector<worker_stats> server::stats() const noexcept
+{
+    std::vector<worker_stats> res;
+    res.reserve(_workers.size());
+    for (auto&& worker : _workers) {
+        res.push_back(worker->stats());
     }
+    return res;
+}
 
-    in_addr addr;
-    addr.s_addr = inet_addr(host.c_str());
+request_handler server::serve_files(const std::string &root) noexcept
+{
+    return static_files(root, _files).get_handler();
+}
 
-    sockaddr_in in;
-    in.sin_family = AF_INET;
-    in.sin_addr = addr;
-    in.sin_port = htons(port);
+executor_stats server::offload_stats() const noexcept
+{
+    return _executor.stats();
+}
 
-    if (bind(_sd, reinterpret_cast<sockaddr*>(&in), sizeof (in)) == -1) {
-        perror("bind");
-        return false;
-    }
+bool server::init(const std::string &host, uint16_t port) noexcept
+{
+    if (_config.reuse_port) {
+        _sds.reserve(_config.workers_num);
+        for (size_t i=0; i<_config.workers_num; ++i) {
+            int sd = listen_socket(host, port);
+            if (sd != -1) {
+                _sds.push_back(sd);
+            } else {
+                return false;
+            }
+        }
+    } else {
+        _sd = listen_socket(host, port);
+        if (_sd == -1) {
+            return false;
+        }
 
-    if (listen(_sd, 1000) == -1) {
-        perror("listen");
-        return false;
+        _wake_d = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (_wake_d == -1) {
+            perror("eventfd");
+            return false;
+        }
     }
 
     LOG(INFO) << "Listen " << host << " " << port;
 
-    const size_t epoll_num = 1;
-    _epolls.reserve(epoll_num);
-    for (size_t i=0; i<epoll_num; ++i) {
-        int fd = epoll_create1(0);
-        if (fd != -1) {
-            _epolls.push_back(fd);
-        } else {
-            perror("epoll_create");
+    for (size_t i=0; i<_config.workers_num; ++i) {
+        int listen_d = _config.reuse_port ? _sds.at(i) : -1;
+        worker* wrk = new worker(listen_d, _config, &_files, &_compressor,
+                                 _request_handler, _uri_handler, _header_handler,
+                                 _body_handler, _async_request_handler);
+        if (!wrk->start()) {
+            delete wrk;
             return false;
         }
-    }
-
-    for (size_t i=0; i<_epolls.size(); ++i) {
-        worker* wrk = new worker(_epolls.at(i));
-        wrk->start();
         _workers.push_back(wrk);
     }
 
@@ -113,43 +221,121 @@ void server::uninit() noexcept
         worker->stop();
         delete worker;
     }
+    _workers.clear();
+
+    for (int sd : _sds) {
+        close(sd);
+    }
+    _sds.clear();
 
     if (_sd != -1) {
         close(_sd);
+        _sd = -1;
+    }
+
+    if (_wake_d != -1) {
+        close(_wake_d);
+        _wake_d = -1;
     }
 }
 
 void server::loop() noexcept
 {
+    pollfd fds[2] = {};
+    fds[0].fd = _sd;
+    fds[1].fd = _wake_d;
+    fds[1].events = POLLIN;
+
     size_t i = 0;
+    int64_t resume_msecs = -1;
     while (_isRunning) {
-        int conn_fd = accept(_sd, nullptr, nullptr);
-        if (conn_fd == -1) {
-            perror("accept");
-            continue;
+        // accepting stops for a while when there are no descriptors left
+        int timeout_msecs = -1;
+        if (resume_msecs != -1) {
+            const int64_t now = datetime::monotonic_msecs();
+            if (now < resume_msecs) {
+                timeout_msecs = static_cast<int>(resume_msecs - now);
+            } else {
+                resume_msecs = -1;
+            }
         }
+        fds[0].events = resume_msecs == -1 ? POLLIN : 0;
 
-        if (fcntl(conn_fd, F_SETFL, O_NONBLOCK) != 0) {
-            perror("fcntl to NONBLOCK");
+        if (poll(fds, 2, timeout_msecs) == -1) {
+            if (errno != EINTR) {
+                perror("poll");
+            }
+            continue;
+        }
+        if ((fds[0].revents & POLLIN) == 0) {
             continue;
         }
 
-        connection* conn = new connection;
-        conn->sock_d = conn_fd;
-        conn->req_handler = _request_handler;
-        conn->req_state_machine = std::make_unique<request_state_machine>(_uri_handler, _header_handler);
+        while (_isRunning) {
+            int conn_fd = accept4(_sd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (conn_fd == -1) {
+                if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                    perror("accept");
+                }
+                if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM) {
+                    resume_msecs = datetime::monotonic_msecs() + accept_pause_msecs;
+                }
+                break;
+            }
 
-        epoll_event in_event;
-        in_event.events = EPOLLIN | EPOLLRDHUP;
-        in_event.data.ptr = conn;
+            _workers.at(i)->add_connection(conn_fd);
 
-        if (epoll_ctl(_epolls.at(i), EPOLL_CTL_ADD, conn_fd, &in_event) == -1) {
-            perror("epoll_ctl");
+            ++i;
+            if (i >= _workers.size()) {
+                i = 0;
+            }
         }
+    }
+}
+
+int server::listen_socket(const std::string &host, uint16_t port) noexcept
+{
+    int sd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sd == -1) {
+        perror("socket");
+        return -1;
+    }
 
-        ++i;
-        if (i >= _epolls.size()) {
-            i = 0;
+    if (_config.reuse_port) {
+        int enable = 1;
+        if (setsockopt(sd, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable)) == -1) {
+            perror("setsockopt SO_REUSEPORT");
+            close(sd);
+            return -1;
         }
     }
+
+    // a worker or the accept thread takes all the pending sockets till EAGAIN
+    if (fcntl(sd, F_SETFL, O_NONBLOCK) != 0) {
+        perror("fcntl to NONBLOCK");
+        close(sd);
+        return -1;
+    }
+
+    in_addr addr;
+    addr.s_addr = inet_addr(host.c_str());
+
+    sockaddr_in in;
+    in.sin_family = AF_INET;
+    in.sin_addr = addr;
+    in.sin_port = htons(port);
+
+    if (bind(sd, reinterpret_cast<sockaddr*>(&in), sizeof (in)) == -1) {
+        perror("bind");
+        close(sd);
+        return -1;
+    }
+
+    if (listen(sd, _config.listen_backlog) == -1) {
+        perror("listen");
+        close(sd);
+        return -1;
+    }
+
+    return sd;
 }
@@ -12,6 +12,13 @@
 #include "response.h"
 #include "connection.h"
 #include "handlers.h"
+#include "server_config.h"
+#include "stats.h"
+#include "executor.h"
+#include "router.h"
+#include "file_cache.h"
+#include "static_files.h"
+#include "compression.h"
 
 namespace http {
 
@@ -28,24 +35,81 @@ public:
                request_handler request_handl,
                uri_handler uri_hand,
                header_handler header_handl) noexcept;
+    bool start(const std::string& host,
+               uint16_t port,
+               request_handler request_handl,
+               uri_handler uri_hand,
+               header_handler header_handl,
+               const server_config& config) noexcept;
+    // request bodies are streamed to the body handler instead of being buffered
+    bool start(const std::string& host,
+               uint16_t port,
+               request_handler request_handl,
+               uri_handler uri_hand,
+               header_handler header_handl,
+               body_handler body_handl,
+               const server_config& config) noexcept;
+    // the request handler completes responses later, so it doesn't block a worker
+    bool start(const std::string& host,
+               uint16_t port,
+               async_request_handler request_handl,
+               uri_handler uri_hand,
+               header_handler header_handl,
+               body_handler body_handl,
+               const server_config& config) noexcept;
+    // requests are matched by the router before the uri handler is called,
+    // the router must outlive the server
+    bool start(const std::string& host,
+               uint16_t port,
+               const router& routes,
+               uri_handler uri_hand,
+               header_handler header_handl,
+               body_handler body_handl,
+               const server_config& config) noexcept;
     void stop() noexcept;
 
+    // runs a CPU heavy handler on the executor of the server, so it doesn't stall
+    // the connections of a worker. Selected routes of an async handler can be passed
+    // to it, the executor threads are started by the first offloaded request.
+    async_request_handler offload(request_handler request_handl) noexcept;
+
+    // serves files under root through the file cache of the server, see static_files
+    request_handler serve_files(const std::string& root) noexcept;
+
+    // per worker stats
+    std::vector<worker_stats> stats() const noexcept;
+    executor_stats offload_stats() const noexcept;
+
 private:
+    bool start(const std::string& host, uint16_t port, const server_config& config) noexcept;
     bool init(const std::string& host, uint16_t port) noexcept;
     void uninit() noexcept;
     void loop() noexcept;
 
+    int listen_socket(const std::string& host, uint16_t port) noexcept;
+
 private:
+    server_config _config;
+
+    // the listening socket of the accept thread or one per worker in reuse_port mode
     int _sd = -1;
-    std::vector<int> _epolls;
+    std::vector<int> _sds;
+    // wakes the accept thread when the server stops
+    int _wake_d = -1;
     std::vector<worker*> _workers;
 
     std::atomic<bool> _isRunning;
     std::thread _thread;
 
     request_handler _request_handler;
+    async_request_handler _async_request_handler;
     uri_handler _uri_handler;
     header_handler _header_handler;
+    body_handler _body_handler;
+
+    executor _executor;
+    file_cache _files;
+    compressor _compressor{_files, _executor};
 };
 
 }
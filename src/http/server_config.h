@@ -0,0 +1,93 @@
+#ifndef SERVER_CONFIG_H
+#define SERVER_CONFIG_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace http {
+
+enum class io_backend
+{
+    epoll,
+    io_uring
+};
+
+struct server_config
+{
+    // 0 means the number of cores
+    size_t workers_num = 0;
+
+    // io_uring falls back to epoll if the kernel doesn't support it
+    io_backend backend = io_backend::epoll;
+
+    // every worker owns a SO_REUSEPORT listening socket and accepts by itself,
+    // otherwise the one server thread accepts and hands sockets to workers
+    bool reuse_port = true;
+
+    int listen_backlog = 1000;
+
+    // a connection is closed after this number of requests, 1 disables keep-alive
+    size_t keep_alive_max_requests = 100;
+
+    // timeouts in msecs, 0 disables a timeout
+    // all headers of a request must come in time
+    int64_t header_timeout = 10000;
+    // a body stalls if no bytes come in time
+    int64_t body_timeout = 30000;
+    // a persistent connection waits for a next request
+    int64_t keep_alive_timeout = 15000;
+    // a response stalls if no bytes are written in time
+    int64_t write_timeout = 30000;
+    // a body producer without data is called again after this interval
+    int64_t producer_poll_interval = 10;
+    // an async request handler must complete in time, otherwise 504 is sent
+    int64_t handler_timeout = 30000;
+
+    // open files kept by the file cache and the time they're used without stat
+    size_t file_cache_size = 4096;
+    int64_t file_cache_ttl = 1000;
+
+    // threads of the executor which runs offloaded handlers, 0 is the number of cores
+    size_t executor_threads_num = 0;
+
+    // bodies of compressible types are sent brotli or gzip encoded if the client accepts it,
+    // bodies from min_size are compressed, from offload_size they're compressed on the executor
+    bool compression = true;
+    size_t compression_min_size = 1024;
+    size_t compression_offload_size = 64*1024;
+    // compressed bodies kept by the hash of their content
+    size_t compression_cache_size = 16*1024*1024;
+    int compression_level = 6;
+
+    // every socket is registered once for EPOLLIN|EPOLLOUT with EPOLLET,
+    // so there are no epoll_ctl calls while a connection switches between read and write
+    bool edge_triggered = false;
+    // a ready connection gets this number of reads and bytes to write per loop turn,
+    // then the rest waits for a next turn to not starve other connections
+    size_t read_budget = 16;
+    size_t write_budget = 256*1024;
+
+    // the number of free objects a worker keeps for next connections
+    size_t connection_pool_size = 1024;
+    size_t request_state_machine_pool_size = 1024;
+    size_t response_reader_pool_size = 1024;
+
+    // a body given to a body handler is read by chunks of this size
+    size_t body_chunk_size = 64*1024;
+
+    // request headers are read into buffers borrowed from a per-worker pool
+    size_t io_buffer_size = 2*1024;
+    size_t io_buffer_pool_size = 1024;
+    bool io_buffer_huge_pages = false;
+
+    // io_uring: the size of a submission queue, received data comes into a ring
+    // of provided buffers, file bodies are read by chunks into pooled buffers of uring_file_buffer_size
+    unsigned uring_entries = 1024;
+    unsigned uring_recv_buffers_num = 1024;
+    size_t uring_recv_buffer_size = 4*1024;
+    size_t uring_file_buffer_size = 64*1024;
+};
+
+}
+
+#endif // SERVER_CONFIG_H
@@ -0,0 +1,157 @@
+#ifndef SMALL_VECTOR_H
+#define SMALL_VECTOR_H
+
+#include <cstddef>
+#include <cstring>
+#include <utility>
+#include <type_traits>
+
+namespace http {
+
+// Vector of trivially copyable items which keeps the first N items inline,
+// so it allocates only when it grows over N.
+template<class T, size_t N>
+class small_vector
+{
+    static_assert(std::is_trivially_copyable<T>::value, "small_vector keeps trivially copyable items");
+
+public:
+    small_vector() noexcept = default;
+
+    ~small_vector()
+    {
+        if (_data != _inline) {
+            delete[] _data;
+        }
+    }
+
+    small_vector(const small_vector& other)
+    {
+        *this = other;
+    }
+
+    small_vector& operator=(const small_vector& other)
+    {
+        if (this != &other) {
+            _size = 0;
+            reserve(other._size);
+            std::memcpy(static_cast<void*>(_data), other._data, other._size * sizeof(T));
+            _size = other._size;
+        }
+        return *this;
+    }
+
+    // a grown buffer is taken over, inline items are copied
+    small_vector(small_vector&& other) noexcept
+    {
+        *this = std::move(other);
+    }
+
+    small_vector& operator=(small_vector&& other) noexcept
+    {
+        if (this == &other) {
+            return *this;
+        }
+
+        if (_data != _inline) {
+            delete[] _data;
+            _data = _inline;
+            _capacity = N;
+        }
+
+        if (other._data != other._inline) {
+            _data = other._data;
+            _capacity = other._capacity;
+            other._data = other._inline;
+            other._capacity = N;
+        } else {
+            std::memcpy(static_cast<void*>(_inline), other._inline, other._size * sizeof(T));
+        }
+        _size = other._size;
+        other._size = 0;
+        return *this;
+    }
+
+    void push_back(const T& item)
+    {
+        if (_size == _capacity) {
+            reserve(_capacity * 2);
+        }
+        _data[_size++] = item;
+    }
+
+    void pop_back() noexcept
+    {
+        --_size;
+    }
+
+    void clear() noexcept
+    {
+        _size = 0;
+    }
+
+    void reserve(size_t capacity)
+    {
+        if (capacity <= _capacity) {
+            return;
+        }
+
+        T* data = new T[capacity];
+        std::memcpy(static_cast<void*>(data), _data, _size * sizeof(T));
+        if (_data != _inline) {
+            delete[] _data;
+        }
+        _data = data;
+        _capacity = capacity;
+    }
+
+    bool empty() const noexcept
+    {
+        return _size == 0;
+    }
+
+    size_t size() const noexcept
+    {
+        return _size;
+    }
+
+    T& operator[](size_t i) noexcept
+    {
+        return _data[i];
+    }
+
+    const T& operator[](size_t i) const noexcept
+    {
+        return _data[i];
+    }
+
+    T* begin() noexcept
+    {
+        return _data;
+    }
+
+    T* end() noexcept
+    {
+        return _data + _size;
+    }
+
+    const T* begin() const noexcept
+    {
+        return _data;
+    }
+
+    const T* end() const noexcept
+    {
+        return _data + _size;
+    }
+
+private:
+    T _inline[N];
+    T* _data = _inline;
+    size_t _size = 0;
+    size_t _capacity = N;
+};
+
+}
+
+#endif // SMALL_VECTOR_H
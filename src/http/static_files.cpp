@@ -0,0 +1,87 @@
+#include "static_files.h"
+
+#include "uri.h"
+
+using namespace http;
+
+static_files::static_files(std::string root, file_cache &files) noexcept :
+    _root(std::move(root)),
+    _files(files)
+{
+    while (!_root.empty() && _root.back() == '/') {
+        _root.pop_back();
+    }
+}
+
+response static_files::handle(const std::shared_ptr<request> &req) const noexcept
+{
+    response resp;
+    if (req->method != request_method::get && req->method != request_method::head) {
+        resp.code = 405;
+        return resp;
+    }
+
+    string path;
+    if (!req->find_param("*", path)) {
+        path = uri(req->uri.data(), req->uri.size()).get_path();
+    }
+
+    std::string file_path;
+    if (!resolve(path, file_path)) {
+        resp.code = 404;
+        return resp;
+    }
+
+    resp.body_file = _files.open(file_path);
+    if (!resp.body_file) {
+        resp.code = 404;
+        return resp;
+    }
+
+    resp.code = 200;
+    resp.content_type = content_type_by_path(file_path);
+    return resp;
+}
+
+request_handler static_files::get_handler() const
+{
+    const static_files files = *this;
+    return [files](std::shared_ptr<request> req) -> response {
+        return files.handle(req);
+    };
+}
+
+bool static_files::resolve(string path, std::string &file_path) const noexcept
+{
+    std::string decoded;
+    path = uri::decode(path, decoded);
+
+    file_path = _root;
+    file_path.reserve(_root.size() + path.size() + 1);
+
+    // segments are copied one by one, so .. can't go above the root
+    const char* pos = path.data();
+    const char* end = path.data() + path.size();
+    while (pos < end) {
+        const char* segment_end = pos;
+        while (segment_end < end && *segment_end != '/') {
+            ++segment_end;
+        }
+
+        const std::string_view segment(pos, static_cast<size_t>(segment_end - pos));
+        if (segment == "..") {
+            return false;
+        }
+        if (segment.find('\0') != std::string_view::npos) {
+            return false;
+        }
+        if (!segment.empty() && segment != ".") {
+            file_path.push_back('/');
+            file_path.append(segment);
+        }
+        pos = segment_end + 1;
+    }
+
+    // the root itself isn't a file
+    return file_path.size() > _root.size();
+}
@@ -0,0 +1,37 @@
+#ifndef STATIC_FILES_H
+#define STATIC_FILES_H
+
+#include <string>
+#include <memory>
+
+#include "request.h"
+#include "response.h"
+#include "handlers.h"
+#include "file_cache.h"
+
+namespace http {
+
+// Handler of GET and HEAD requests for files under a root directory. The file
+// path is the * param of a route if there is one, otherwise the path of the uri.
+// Paths are decoded, paths with .. segments are rejected.
+class static_files
+{
+public:
+    static_files(std::string root, file_cache& files) noexcept;
+
+    response handle(const std::shared_ptr<request>& req) const noexcept;
+    // the cache must outlive the handler
+    request_handler get_handler() const;
+
+private:
+    // returns false if the path leaves the root
+    bool resolve(string path, std::string& file_path) const noexcept;
+
+private:
+    std::string _root;
+    file_cache& _files;
+};
+
+}
+
+#endif // STATIC_FILES_H
@@ -0,0 +1,49 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+
+namespace http {
+
+struct pool_stats
+{
+    // objects got from the free list
+    size_t hits = 0;
+    // objects allocated because the free list was empty
+    size_t misses = 0;
+    // objects in the free list
+    size_t free_size = 0;
+};
+
+struct worker_stats
+{
+    pool_stats connections;
+    pool_stats request_state_machines;
+    pool_stats response_readers;
+    pool_stats io_buffers;
+};
+
+struct executor_stats
+{
+    // tasks waiting in the queues
+    size_t queued = 0;
+    size_t executed = 0;
+    // tasks taken from the queue of another thread
+    size_t stolen = 0;
+    // the time tasks spent in the queues and running
+    uint64_t wait_usecs = 0;
+    uint64_t run_usecs = 0;
+};
+
+// counters are written by one owner thread and read by others,
+// so they don't need atomic increments
+inline void stats_increment(std::atomic<size_t>& counter) noexcept
+{
+    counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+}
+
+#endif // STATS_H
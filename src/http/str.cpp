@@ -4,6 +4,7 @@
 #include <cstdint>
 #include <cstdlib>
 #include <cstring>
+#include <strings.h>
 
 using namespace http;
 
@@ -51,6 +52,15 @@ int string::compare(const char *str) const
     return strncmp(_buff, str, _size);
 }
 
+int string::compare_nocase(const char *str) const
+{
+    size_t str_size = strlen(str);
+    if (_size != str_size) {
+        return static_cast<int>(_size) - static_cast<int>(str_size);
+    }
+    return strncasecmp(_buff, str, _size);
+}
+
 void http::string::trim()
 {
     while(_size > 0 && _buff[0] == 0x20) {
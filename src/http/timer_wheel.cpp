@@ -0,0 +1,188 @@
+#include "timer_wheel.h"
+
+#include <limits>
+#include <algorithm>
+
+using namespace http;
+
+timer_wheel::timer_wheel(int64_t now_msecs, int64_t tick_msecs) noexcept :
+    _tick_msecs(tick_msecs)
+{
+    _current = to_ticks(now_msecs);
+}
+
+void timer_wheel::schedule(timer_node *node, int64_t expires_msecs) noexcept
+{
+    if (node->armed) {
+        unlink(node);
+    }
+
+    // the current tick is already expired, so round up and start from the next one
+    int64_t expires = (expires_msecs + _tick_msecs - 1) / _tick_msecs;
+    node->expires = std::max(expires, _current + 1);
+
+    link(node);
+}
+
+void timer_wheel::cancel(timer_node *node) noexcept
+{
+    if (node->armed) {
+        unlink(node);
+    }
+}
+
+timer_node *timer_wheel::advance(int64_t now_msecs) noexcept
+{
+    const int64_t target = to_ticks(now_msecs);
+
+    timer_node* expired = nullptr;
+
+    while (_current < target) {
+        if (_size == 0) {
+            _current = target;
+            break;
+        }
+
+        ++_current;
+
+        const size_t index = static_cast<size_t>(_current) & (slots_num - 1);
+        if (index == 0) {
+            for (size_t level = 1; level < levels_num; ++level) {
+                cascade(level);
+                size_t level_index = static_cast<size_t>(_current >> (level * level_bits)) & (slots_num - 1);
+                if (level_index != 0) {
+                    break;
+                }
+            }
+        }
+
+        timer_node* node = _slots[0][index];
+        while (node != nullptr) {
+            timer_node* next = node->next;
+
+            unlink(node);
+            node->next = expired;
+            expired = node;
+
+            node = next;
+        }
+    }
+
+    return expired;
+}
+
+int timer_wheel::next_timeout(int64_t now_msecs) const noexcept
+{
+    if (_size == 0) {
+        return -1;
+    }
+
+    int64_t nearest = std::numeric_limits<int64_t>::max();
+
+    for (size_t level = 0; level < levels_num; ++level) {
+        const uint64_t occupied = _occupied[level];
+        if (occupied == 0) {
+            continue;
+        }
+
+        // slots of a level are visited one by one, so look for the first occupied after the current
+        const size_t shift = level * level_bits;
+        const int64_t position = (_current >> shift) + 1;
+        const size_t rotate = static_cast<size_t>(position) & (slots_num - 1);
+        const uint64_t rotated = rotate == 0 ? occupied : (occupied >> rotate) | (occupied << (slots_num - rotate));
+        const int64_t distance = __builtin_ctzll(rotated);
+
+        // a higher level slot is reached when it's cascaded
+        const int64_t ticks = (position + distance) << shift;
+        nearest = std::min(nearest, ticks);
+    }
+
+    const int64_t msecs = nearest * _tick_msecs - now_msecs;
+    if (msecs <= 0) {
+        return 0;
+    }
+    if (msecs > std::numeric_limits<int>::max()) {
+        return std::numeric_limits<int>::max();
+    }
+    return static_cast<int>(msecs);
+}
+
+size_t timer_wheel::size() const noexcept
+{
+    return _size;
+}
+
+void timer_wheel::link(timer_node *node) noexcept
+{
+    // the last level keeps everything that is too far
+    const int64_t max_delta = (int64_t(1) << (levels_num * level_bits)) - 1;
+    if (node->expires - _current > max_delta) {
+        node->expires = _current + max_delta;
+    }
+
+    const int64_t delta = node->expires - _current;
+
+    size_t level = 0;
+    while (level + 1 < levels_num && delta >= (int64_t(1) << ((level + 1) * level_bits))) {
+        ++level;
+    }
+
+    const size_t slot = static_cast<size_t>(node->expires >> (level * level_bits)) & (slots_num - 1);
+
+    timer_node*& head = _slots[level][slot];
+    node->prev = nullptr;
+    node->next = head;
+    if (head != nullptr) {
+        head->prev = node;
+    }
+    head = node;
+
+    node->level = static_cast<uint8_t>(level);
+    node->slot = static_cast<uint8_t>(slot);
+    node->armed = true;
+
+    _occupied[level] |= uint64_t(1) << slot;
+    ++_size;
+}
+
+void timer_wheel::unlink(timer_node *node) noexcept
+{
+    timer_node*& head = _slots[node->level][node->slot];
+    if (node->prev != nullptr) {
+        node->prev->next = node->next;
+    } else {
+        head = node->next;
+    }
+    if (node->next != nullptr) {
+        node->next->prev = node->prev;
+    }
+
+    if (head == nullptr) {
+        _occupied[node->level] &= ~(uint64_t(1) << node->slot);
+    }
+
+    node->prev = nullptr;
+    node->next = nullptr;
+    node->armed = false;
+    --_size;
+}
+
+void timer_wheel::cascade(size_t level) noexcept
+{
+    const size_t index = static_cast<size_t>(_current >> (level * level_bits)) & (slots_num - 1);
+
+    timer_node* node = _slots[level][index];
+    while (node != nullptr) {
+        timer_node* next = node->next;
+
+        unlink(node);
+        link(node);
+
+        node = next;
+    }
+}
+
+int64_t timer_wheel::to_ticks(int64_t msecs) const noexcept
+{
+    return msecs / _tick_msecs;
+}
@@ -0,0 +1,64 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <cstdint>
+#include <cstddef>
+
+namespace http {
+
+struct timer_node
+{
+    timer_node* prev = nullptr;
+    timer_node* next = nullptr;
+
+    // in ticks of the wheel
+    int64_t expires = 0;
+    bool armed = false;
+    uint8_t level = 0;
+    uint8_t slot = 0;
+
+    void* data = nullptr;
+};
+
+// Hierarchical timer wheel: schedule, cancel and expire are O(1),
+// far deadlines are cascaded down to lower levels while time goes on.
+// It isn't thread safe and belongs to one worker.
+class timer_wheel
+{
+public:
+    timer_wheel(int64_t now_msecs, int64_t tick_msecs = 10) noexcept;
+
+    void schedule(timer_node* node, int64_t expires_msecs) noexcept;
+    void cancel(timer_node* node) noexcept;
+
+    // returns expired nodes linked by timer_node::next
+    timer_node* advance(int64_t now_msecs) noexcept;
+
+    // msecs till the nearest deadline or -1 if there are no timers
+    int next_timeout(int64_t now_msecs) const noexcept;
+
+    size_t size() const noexcept;
+
+private:
+    void link(timer_node* node) noexcept;
+    void unlink(timer_node* node) noexcept;
+    void cascade(size_t level) noexcept;
+
+    int64_t to_ticks(int64_t msecs) const noexcept;
+
+private:
+    static const size_t level_bits = 6;
+    static const size_t slots_num = 1 << level_bits;
+    static const size_t levels_num = 4;
+
+    int64_t _tick_msecs = 10;
+    int64_t _current = 0;
+    size_t _size = 0;
+
+    timer_node* _slots[levels_num][slots_num] = {};
+    uint64_t _occupied[levels_num] = {};
+};
+
+}
+
+#endif // TIMER_WHEEL_H
@@ -1,15 +1,94 @@
 #include "uri.h"
 
-#include <cassert>
+#include <cstring>
+#include <algorithm>
+#include <string_view>
 
 using namespace http;
 
+namespace {
+
+struct hex_table
+{
+    int8_t values[256];
+
+    constexpr hex_table() noexcept : values()
+    {
+        for (int i=0; i<256; ++i) {
+            values[i] = -1;
+        }
+        for (int i=0; i<10; ++i) {
+            values['0' + i] = static_cast<int8_t>(i);
+        }
+        for (int i=0; i<6; ++i) {
+            values['a' + i] = static_cast<int8_t>(10 + i);
+            values['A' + i] = static_cast<int8_t>(10 + i);
+        }
+    }
+};
+
+constexpr hex_table hex;
+
+int hex_value(char ch) noexcept
+{
+    return hex.values[static_cast<uint8_t>(ch)];
+}
+
+std::string_view to_view(string str) noexcept
+{
+    return std::string_view(str.data(), str.size());
+}
+
+// escapes are checked once, so items can be decoded without errors later
+bool valid_escapes(const char* buff, size_t size) noexcept
+{
+    if (size == 0) {
+        return true;
+    }
+
+    const char* end = buff + size;
+    const char* pos = static_cast<const char*>(memchr(buff, '%', size));
+    while (pos != nullptr) {
+        if (end - pos < 3 || hex_value(pos[1]) == -1 || hex_value(pos[2]) == -1) {
+            return false;
+        }
+        pos += 3;
+        pos = static_cast<const char*>(memchr(pos, '%', end - pos));
+    }
+    return true;
+}
+
+bool valid_query(string query) noexcept
+{
+    // every item has a key and a value, empty items between them are skipped
+    // like by string::split, but a query of separators only has no items
+    size_t items_num = 0;
+    const char* item = query.data();
+    const char* end = query.data() + query.size();
+    while (item < end) {
+        const char* item_end = static_cast<const char*>(memchr(item, '&', end - item));
+        if (item_end == nullptr) {
+            item_end = end;
+        }
+
+        if (item != item_end) {
+            const char* eq = static_cast<const char*>(memchr(item, '=', item_end - item));
+            if (eq == nullptr || eq == item || eq + 1 == item_end) {
+                return false;
+            }
+            ++items_num;
+        }
+        item = item_end + 1;
+    }
+    return query.empty() || items_num > 0;
+}
+
+}
+
 uri::uri() noexcept
 {
 }
 
-// TODO: /path?sta?rt=10&&&: onle one ?
-// TODO: path///?start=10&&&duration=5: must starts with /
 uri::uri(const char* buff, size_t size) noexcept :
     _buff(buff),
     _size(size)
@@ -19,42 +98,21 @@ uri::uri(const char* buff, size_t size) noexcept :
     string str(buff, size);
     str.trim();
 
-    string path_str = str.cut_by('?');
-    string query_str;
-    if (path_str.empty()) {
-        if (!str.empty()) {
-            path_str = str;
-            query_str = string();
-        } else {
-            return;
-        }
-    } else if (!str.empty()) {
-        query_str = str;
+    const char* question = static_cast<const char*>(memchr(str.data(), '?', str.size()));
+    if (question != nullptr) {
+        _path = string(str.data(), question - str.data());
+        _query = string(question + 1, str.data() + str.size() - question - 1);
+    } else {
+        _path = str;
     }
 
-    assert(!path_str.empty());
-
-    _path_items = path_str.split('/');
-    if (_path_items.empty()) {
+    // the path has at least one item
+    if (std::all_of(_path.data(), _path.data() + _path.size(), [](char ch) { return ch == '/'; })) {
         return;
     }
 
-    if (!query_str.empty()) {
-        std::vector<string> quaries = query_str.split('&');
-        if (quaries.empty()) {
-            quaries.push_back(query_str);
-        }
-
-        assert(!quaries.empty());
-
-        for (string query : quaries) {
-            string key = query.cut_by('=');
-            if (!key.empty() && !query.empty()) {
-                _query_items.push_back({key, query});
-            } else {
-                return;
-            }
-        }
+    if (!valid_query(_query) || !valid_escapes(str.data(), str.size())) {
+        return;
     }
 
     _is_valid = true;
@@ -65,22 +123,66 @@ bool uri::is_valid() const
     return _is_valid;
 }
 
-std::vector<string> uri::get_path_items() const noexcept
+const char *uri::data() const noexcept
+{
+    return _buff;
+}
+
+size_t uri::size() const noexcept
+{
+    return _size;
+}
+
+string uri::get_path() const noexcept
+{
+    return _path;
+}
+
+string uri::get_query() const noexcept
 {
+    return _query;
+}
+
+const path_items &uri::get_path_items() const noexcept
+{
+    if (!_path_split) {
+        split_path();
+    }
     return _path_items;
 }
 
-std::vector<query> uri::get_query_items() const noexcept
+const query_items &uri::get_query_items() const noexcept
 {
+    if (!_query_split) {
+        split_query();
+    }
     return _query_items;
 }
 
 string uri::find_query_item(const char* key) const noexcept
 {
-    for (auto&& item : _query_items) {
-        if (item.first.compare(key) == 0) {
-            return item.second;
+    auto&& items = get_query_items();
+
+    if (items.size() < query_index_min_size) {
+        for (auto&& item : items) {
+            if (item.first.compare(key) == 0) {
+                return item.second;
+            }
         }
+        return string();
+    }
+
+    if (!_query_indexed) {
+        index_query();
+    }
+
+    const std::string_view key_view(key);
+    auto it = std::lower_bound(_query_index.begin(), _query_index.end(), key_view,
+                               [&items](uint32_t i, std::string_view key) {
+        return to_view(items[i].first) < key;
+    });
+    if (it != _query_index.end() && to_view(items[*it].first) == key_view) {
+        return items[*it].second;
     }
     return string();
 }
@@ -93,3 +195,118 @@ std::string uri::to_str() const noexcept
         return std::string();
     }
 }
+
+bool uri::decode(const char *src, size_t size, char *dst, size_t &dst_size, bool query) noexcept
+{
+    size_t j = 0;
+    size_t i = 0;
+    while (i < size) {
+        // plain runs are moved at once
+        const char* escape = static_cast<const char*>(memchr(src + i, '%', size - i));
+        const size_t run = escape != nullptr ? static_cast<size_t>(escape - src) - i : size - i;
+        if (dst + j != src + i) {
+            memmove(dst + j, src + i, run);
+        }
+        if (query) {
+            std::replace(dst + j, dst + j + run, '+', ' ');
+        }
+        i += run;
+        j += run;
+
+        if (i == size) {
+            break;
+        }
+
+        if (size - i < 3) {
+            return false;
+        }
+        const int high = hex_value(src[i + 1]);
+        const int low = hex_value(src[i + 2]);
+        if (high == -1 || low == -1) {
+            return false;
+        }
+        dst[j++] = static_cast<char>((high << 4) | low);
+        i += 3;
+    }
+
+    dst_size = j;
+    return true;
+}
+
+string uri::decode(string item, std::string &storage, bool query)
+{
+    if (item.empty()) {
+        return item;
+    }
+
+    const bool escaped = memchr(item.data(), '%', item.size()) != nullptr;
+    if (!escaped && (!query || memchr(item.data(), '+', item.size()) == nullptr)) {
+        return item;
+    }
+
+    storage.resize(item.size());
+    size_t size = 0;
+    if (!decode(item.data(), item.size(), &storage[0], size, query)) {
+        return string();
+    }
+    storage.resize(size);
+    return string(storage.data(), storage.size());
+}
+
+void uri::split_path() const noexcept
+{
+    _path_items.clear();
+
+    // empty items between slashes are skipped
+    const char* pos = _path.data();
+    const char* end = _path.data() + _path.size();
+    while (pos < end) {
+        const char* item_end = static_cast<const char*>(memchr(pos, '/', end - pos));
+        if (item_end == nullptr) {
+            item_end = end;
+        }
+        if (item_end != pos) {
+            _path_items.push_back(string(pos, item_end - pos));
+        }
+        pos = item_end + 1;
+    }
+    _path_split = true;
+}
+
+void uri::split_query() const noexcept
+{
+    _query_items.clear();
+
+    const char* pos = _query.data();
+    const char* end = _query.data() + _query.size();
+    while (pos < end) {
+        const char* item_end = static_cast<const char*>(memchr(pos, '&', end - pos));
+        if (item_end == nullptr) {
+            item_end = end;
+        }
+        if (item_end != pos) {
+            // the items of a valid uri are checked by the constructor
+            const char* eq = static_cast<const char*>(memchr(pos, '=', item_end - pos));
+            if (eq == nullptr) {
+                break;
+            }
+            _query_items.push_back({string(pos, eq - pos), string(eq + 1, item_end - eq - 1)});
+        }
+        pos = item_end + 1;
+    }
+    _query_split = true;
+}
+
+void uri::index_query() const noexcept
+{
+    _query_index.clear();
+    for (size_t i=0; i<_query_items.size(); ++i) {
+        _query_index.push_back(static_cast<uint32_t>(i));
+    }
+
+    // equal keys keep their order, so the first one is found like by a scan
+    std::stable_sort(_query_index.begin(), _query_index.end(), [this](uint32_t a, uint32_t b) {
+        return to_view(_query_items[a].first) < to_view(_query_items[b].first);
+    });
+    _query_indexed = true;
+}
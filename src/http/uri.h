@@ -2,13 +2,41 @@
 #define URI_H
 
 #include <string>
+#include <cstdint>
+#include <utility>
 
 #include "str.h"
+#include "small_vector.h"
 
 namespace http {
 
-typedef std::pair<string, string> query;
+// a key and a value, it's used like the std::pair it used to be,
+// but it's trivially copyable, so it's kept by small_vector
+struct query
+{
+    query() noexcept = default;
+    query(string key, string value) noexcept :
+        first(key), second(value)
+    {}
+    query(const std::pair<string, string>& pair) noexcept :
+        first(pair.first), second(pair.second)
+    {}
+
+    operator std::pair<string, string>() const noexcept
+    {
+        return {first, second};
+    }
+
+    string first;
+    string second;
+};
+
+typedef small_vector<string, 8> path_items;
+typedef small_vector<query, 8> query_items;
 
+// Request target as views into the receive buffer. It's validated once,
+// the items are split on the first call and kept inline, so nothing is
+// allocated for usual uris. Items aren't decoded, decode() does it on demand.
 class uri
 {
 public:
@@ -17,21 +45,51 @@ public:
 
     bool is_valid() const;
 
-    std::vector<string> get_path_items() const noexcept;
-    std::vector<query> get_query_items() const noexcept;
+    const char* data() const noexcept;
+    size_t size() const noexcept;
+
+    // the path without the query
+    string get_path() const noexcept;
+    string get_query() const noexcept;
+    const path_items& get_path_items() const noexcept;
+    const query_items& get_query_items() const noexcept;
 
+    // a lookup over many items builds a sorted index at the first call
     string find_query_item(const char *key) const noexcept;
 
     std::string to_str() const noexcept;
 
+    // decodes %XX escapes and + of a query into dst, dst can be src,
+    // returns false if an escape is malformed
+    static bool decode(const char* src, size_t size, char* dst, size_t& dst_size, bool query = false) noexcept;
+    // returns the item itself if there is nothing to decode,
+    // otherwise it's decoded into storage
+    static string decode(string item, std::string& storage, bool query = false);
+
+private:
+    void split_path() const noexcept;
+    void split_query() const noexcept;
+    void index_query() const noexcept;
+
 private:
+    // lookups over fewer items just scan them
+    static const size_t query_index_min_size = 8;
+
     bool _is_valid = false;
 
     const char* _buff = nullptr;
     size_t _size = 0;
 
-    std::vector<string> _path_items;
-    std::vector<query> _query_items;
+    string _path;
+    string _query;
+
+    mutable bool _path_split = false;
+    mutable bool _query_split = false;
+    mutable bool _query_indexed = false;
+    mutable path_items _path_items;
+    mutable query_items _query_items;
+    // query items sorted by keys
+    mutable small_vector<uint32_t, 16> _query_index;
 };
 
 }
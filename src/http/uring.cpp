@@ -0,0 +1,253 @@
+#include "uring.h"
+
+#include <cstring>
+#include <cerrno>
+#include <cstdio>
+#include <memory>
+#include <algorithm>
+
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <glog/logging.h>
+
+using namespace http;
+
+uring::~uring()
+{
+    if (_ring_d != -1) {
+        close(_ring_d);
+    }
+    if (_ring != nullptr) {
+        munmap(_ring, _ring_size);
+    }
+    if (_sqes != nullptr) {
+        munmap(_sqes, _sqes_size);
+    }
+    if (_buff_ring != nullptr) {
+        munmap(_buff_ring, _buff_ring_size);
+    }
+    if (_buffs != nullptr) {
+        munmap(_buffs, _buffs_size);
+    }
+}
+
+bool uring::init(unsigned entries) noexcept
+{
+    // completions of multishot operations come more often than submissions
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SUBMIT_ALL | IORING_SETUP_COOP_TASKRUN;
+    params.cq_entries = entries * 4;
+
+    _ring_d = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+    if (_ring_d == -1 && errno == EINVAL) {
+        // older kernels don't know the optimization flags
+        std::memset(&params, 0, sizeof(params));
+        params.flags = IORING_SETUP_CQSIZE;
+        params.cq_entries = entries * 4;
+        _ring_d = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+    }
+    if (_ring_d == -1) {
+        perror("io_uring_setup");
+        return false;
+    }
+
+    const unsigned required = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG;
+    if ((params.features & required) != required) {
+        LOG(WARNING) << "io_uring of the kernel misses required features";
+        return false;
+    }
+
+    const size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    const size_t cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    _ring_size = std::max(sq_size, cq_size);
+
+    void* ring = mmap(nullptr, _ring_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, _ring_d, IORING_OFF_SQ_RING);
+    if (ring == MAP_FAILED) {
+        perror("mmap io_uring");
+        return false;
+    }
+    _ring = ring;
+
+    _sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = mmap(nullptr, _sqes_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, _ring_d, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        perror("mmap io_uring sqes");
+        return false;
+    }
+    _sqes = reinterpret_cast<io_uring_sqe*>(sqes);
+
+    char* base = reinterpret_cast<char*>(_ring);
+    _sq_head = reinterpret_cast<unsigned*>(base + params.sq_off.head);
+    _sq_tail = reinterpret_cast<unsigned*>(base + params.sq_off.tail);
+    _sq_array = reinterpret_cast<unsigned*>(base + params.sq_off.array);
+    _sq_mask = *reinterpret_cast<unsigned*>(base + params.sq_off.ring_mask);
+    _sq_entries = params.sq_entries;
+    _sq_local_tail = *_sq_tail;
+
+    // entries are taken in order, so the indirection array is set once
+    for (unsigned i=0; i<_sq_entries; ++i) {
+        _sq_array[i] = i;
+    }
+
+    _cq_head = reinterpret_cast<unsigned*>(base + params.cq_off.head);
+    _cq_tail = reinterpret_cast<unsigned*>(base + params.cq_off.tail);
+    _cqes = reinterpret_cast<io_uring_cqe*>(base + params.cq_off.cqes);
+    _cq_mask = *reinterpret_cast<unsigned*>(base + params.cq_off.ring_mask);
+
+    return true;
+}
+
+bool uring::supports(std::initializer_list<uint8_t> opcodes) noexcept
+{
+    const unsigned ops_num = 256;
+    std::unique_ptr<char[]> buff(new char[sizeof(io_uring_probe) + ops_num * sizeof(io_uring_probe_op)]());
+    io_uring_probe* probe = reinterpret_cast<io_uring_probe*>(buff.get());
+
+    if (syscall(__NR_io_uring_register, _ring_d, IORING_REGISTER_PROBE, probe, ops_num) == -1) {
+        perror("io_uring_register probe");
+        return false;
+    }
+
+    for (uint8_t opcode : opcodes) {
+        if (opcode > probe->last_op || !(probe->ops[opcode].flags & IO_URING_OP_SUPPORTED)) {
+            LOG(WARNING) << "io_uring of the kernel doesn't support opcode " << static_cast<int>(opcode);
+            return false;
+        }
+    }
+    return true;
+}
+
+io_uring_sqe *uring::get_sqe() noexcept
+{
+    if (_sq_local_tail - __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE) >= _sq_entries) {
+        submit_and_wait(0);
+        if (_sq_local_tail - __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE) >= _sq_entries) {
+            return nullptr;
+        }
+    }
+
+    io_uring_sqe* sqe = &_sqes[_sq_local_tail & _sq_mask];
+    ++_sq_local_tail;
+
+    std::memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+int uring::submit_and_wait(int timeout_msecs) noexcept
+{
+    __atomic_store_n(_sq_tail, _sq_local_tail, __ATOMIC_RELEASE);
+    const unsigned to_submit = _sq_local_tail - __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE);
+
+    // don't sleep if completions are already there
+    if (timeout_msecs == 0 || peek_cqe() != nullptr) {
+        if (to_submit == 0) {
+            return 0;
+        }
+        return enter(to_submit, 0, 0, nullptr, 0);
+    }
+
+    if (timeout_msecs < 0) {
+        return enter(to_submit, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+    }
+
+    __kernel_timespec ts;
+    ts.tv_sec = timeout_msecs / 1000;
+    ts.tv_nsec = static_cast<long long>(timeout_msecs % 1000) * 1000000;
+
+    io_uring_getevents_arg arg;
+    std::memset(&arg, 0, sizeof(arg));
+    arg.ts = reinterpret_cast<uint64_t>(&ts);
+
+    return enter(to_submit, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+}
+
+io_uring_cqe *uring::peek_cqe() noexcept
+{
+    const unsigned head = *_cq_head;
+    if (head == __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE)) {
+        return nullptr;
+    }
+    return &_cqes[head & _cq_mask];
+}
+
+void uring::cqe_seen() noexcept
+{
+    __atomic_store_n(_cq_head, *_cq_head + 1, __ATOMIC_RELEASE);
+}
+
+bool uring::register_buffers(uint16_t group_id, unsigned entries, size_t buff_size) noexcept
+{
+    _buff_ring_size = entries * sizeof(io_uring_buf);
+    void* ring = mmap(nullptr, _buff_ring_size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring == MAP_FAILED) {
+        perror("mmap buffer ring");
+        return false;
+    }
+    _buff_ring = reinterpret_cast<io_uring_buf*>(ring);
+    _buff_ring_tail = &reinterpret_cast<io_uring_buf_ring*>(ring)->tail;
+
+    _buffs_size = entries * buff_size;
+    void* buffs = mmap(nullptr, _buffs_size, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buffs == MAP_FAILED) {
+        perror("mmap buffers");
+        return false;
+    }
+    _buffs = reinterpret_cast<char*>(buffs);
+
+    io_uring_buf_reg reg;
+    std::memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = reinterpret_cast<uint64_t>(_buff_ring);
+    reg.ring_entries = entries;
+    reg.bgid = group_id;
+
+    if (syscall(__NR_io_uring_register, _ring_d, IORING_REGISTER_PBUF_RING, &reg, 1) == -1) {
+        perror("io_uring_register buffer ring");
+        return false;
+    }
+
+    _buff_size = buff_size;
+    _buff_mask = entries - 1;
+    for (unsigned i=0; i<entries; ++i) {
+        recycle_buffer(static_cast<uint16_t>(i));
+    }
+
+    return true;
+}
+
+char *uring::buffer(uint16_t buff_id) const noexcept
+{
+    return _buffs + buff_id * _buff_size;
+}
+
+size_t uring::buffer_size() const noexcept
+{
+    return _buff_size;
+}
+
+void uring::recycle_buffer(uint16_t buff_id) noexcept
+{
+    io_uring_buf* buf = &_buff_ring[_buff_tail & _buff_mask];
+    buf->addr = reinterpret_cast<uint64_t>(buffer(buff_id));
+    buf->len = static_cast<uint32_t>(_buff_size);
+    buf->bid = buff_id;
+
+    ++_buff_tail;
+    __atomic_store_n(_buff_ring_tail, _buff_tail, __ATOMIC_RELEASE);
+}
+
+int uring::enter(unsigned to_submit, unsigned min_complete, unsigned flags,
+                 const void *arg, size_t arg_size) noexcept
+{
+    int res = static_cast<int>(syscall(__NR_io_uring_enter, _ring_d, to_submit, min_complete,
+                                       flags, arg, arg_size));
+    if (res == -1 && errno != ETIME && errno != EINTR && errno != EBUSY && errno != EAGAIN) {
+        perror("io_uring_enter");
+    }
+    return res;
+}
@@ -0,0 +1,83 @@
+#ifndef URING_H
+#define URING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+
+#include <linux/io_uring.h>
+
+namespace http {
+
+// Thin wrapper of an io_uring instance over the raw syscalls.
+// It isn't thread safe and belongs to one worker.
+class uring
+{
+public:
+    uring() noexcept = default;
+    ~uring();
+
+    uring(const uring&) = delete;
+    uring& operator=(const uring&) = delete;
+
+    bool init(unsigned entries) noexcept;
+    // the kernel knows all the opcodes, flags of them aren't probed
+    bool supports(std::initializer_list<uint8_t> opcodes) noexcept;
+
+    // submits the queued entries if the submission queue is full
+    io_uring_sqe* get_sqe() noexcept;
+
+    // submits the queued entries and waits for a completion up to timeout msecs,
+    // -1 waits without a timeout
+    int submit_and_wait(int timeout_msecs) noexcept;
+
+    io_uring_cqe* peek_cqe() noexcept;
+    void cqe_seen() noexcept;
+
+    // a ring of provided buffers for receives with IOSQE_BUFFER_SELECT
+    bool register_buffers(uint16_t group_id, unsigned entries, size_t buff_size) noexcept;
+    char* buffer(uint16_t buff_id) const noexcept;
+    size_t buffer_size() const noexcept;
+    // gives a consumed buffer back to the kernel
+    void recycle_buffer(uint16_t buff_id) noexcept;
+
+private:
+    int enter(unsigned to_submit, unsigned min_complete, unsigned flags,
+              const void* arg, size_t arg_size) noexcept;
+
+private:
+    int _ring_d = -1;
+
+    void* _ring = nullptr;
+    size_t _ring_size = 0;
+    io_uring_sqe* _sqes = nullptr;
+    size_t _sqes_size = 0;
+
+    unsigned* _sq_head = nullptr;
+    unsigned* _sq_tail = nullptr;
+    unsigned* _sq_array = nullptr;
+    unsigned _sq_mask = 0;
+    unsigned _sq_entries = 0;
+    // the entries got by get_sqe but not submitted yet
+    unsigned _sq_local_tail = 0;
+
+    unsigned* _cq_head = nullptr;
+    unsigned* _cq_tail = nullptr;
+    io_uring_cqe* _cqes = nullptr;
+    unsigned _cq_mask = 0;
+
+    // the kernel header declares bufs of io_uring_buf_ring by a macro that
+    // shifts it in C++, so the ring is indexed as an array of io_uring_buf
+    io_uring_buf* _buff_ring = nullptr;
+    uint16_t* _buff_ring_tail = nullptr;
+    size_t _buff_ring_size = 0;
+    char* _buffs = nullptr;
+    size_t _buffs_size = 0;
+    size_t _buff_size = 0;
+    unsigned _buff_mask = 0;
+    uint16_t _buff_tail = 0;
+};
+
+}
+
+#endif // URING_H
@@ -0,0 +1,649 @@
+#include "uring_reactor.h"
+
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <glog/logging.h>
+
+#include "connection.h"
+#include "../utility/datetime.h"
+
+using namespace http;
+
+namespace {
+
+unsigned round_up_pow2(unsigned value) noexcept
+{
+    unsigned res = 1;
+    while (res < value) {
+        res <<= 1;
+    }
+    return res;
+}
+
+}
+
+// the low bits of user data keep an operation
+static_assert(alignof(connection) >= 8, "connection pointers must have 3 free bits");
+
+uring_reactor::uring_reactor(reactor_handler *handler, const server_config &config) noexcept :
+    _handler(handler),
+    _entries(round_up_pow2(std::max(config.uring_entries, 16u))),
+    _buffers_num(round_up_pow2(std::min(std::max(config.uring_recv_buffers_num, 1u), 32768u))),
+    _buffer_size(config.uring_recv_buffer_size),
+    _file_buffers(config.uring_file_buffer_size, config.io_buffer_pool_size, false)
+{
+}
+
+uring_reactor::~uring_reactor() = default;
+
+bool uring_reactor::init(int listen_d, int wake_d) noexcept
+{
+    if (!_ring.init(_entries)) {
+        return false;
+    }
+    if (!_ring.supports({IORING_OP_ACCEPT, IORING_OP_POLL_ADD, IORING_OP_RECV,
+                         IORING_OP_SEND, IORING_OP_SENDMSG, IORING_OP_READ})) {
+        return false;
+    }
+    if (!_ring.register_buffers(buffer_group, _buffers_num, _buffer_size)) {
+        return false;
+    }
+    // multishot accept (5.19) is older than multishot receive
+    if (!probe_multishot_recv()) {
+        LOG(WARNING) << "io_uring of the kernel doesn't support multishot receive";
+        return false;
+    }
+
+    _buff_next.assign(_buffers_num, -1);
+    _buff_size.assign(_buffers_num, 0);
+    _free_buffers = _buffers_num;
+
+    _listen_d = listen_d;
+    if (_listen_d != -1 && !arm_accept()) {
+        return false;
+    }
+
+    _wake_d = wake_d;
+    if (_wake_d != -1 && !arm_wake()) {
+        return false;
+    }
+
+    return true;
+}
+
+void uring_reactor::wait(int timeout_msecs) noexcept
+{
+    if (_accept_resume_msecs != -1) {
+        const int64_t pause_msecs = std::max<int64_t>(_accept_resume_msecs - datetime::monotonic_msecs(), 0);
+        if (timeout_msecs == -1 || pause_msecs < timeout_msecs) {
+            timeout_msecs = static_cast<int>(pause_msecs);
+        }
+    }
+    _ring.submit_and_wait(timeout_msecs);
+}
+
+void uring_reactor::dispatch() noexcept
+{
+    io_uring_cqe* cqe = nullptr;
+    while ((cqe = _ring.peek_cqe()) != nullptr) {
+        // handlers submit new operations, so the entry is freed before
+        const io_uring_cqe copy = *cqe;
+        _ring.cqe_seen();
+
+        handle_cqe(copy);
+    }
+
+    rearm_starved();
+    resume_accept();
+}
+
+bool uring_reactor::edge_triggered() const noexcept
+{
+    return true;
+}
+
+bool uring_reactor::open(connection *conn) noexcept
+{
+    // a connected socket can be written at once
+    conn->writable = true;
+    return arm_recv(conn);
+}
+
+bool uring_reactor::watch(connection *) noexcept
+{
+    // receives are armed all the time and sends are submitted on demand
+    return true;
+}
+
+void uring_reactor::close(connection *conn) noexcept
+{
+    uring_state& st = conn->uring;
+    st.closing = true;
+
+    recycle_received(conn);
+
+    if (st.starved) {
+        auto it = std::find(_starved.begin(), _starved.end(), conn);
+        if (it != _starved.end()) {
+            _starved.erase(it);
+        }
+        st.starved = false;
+    }
+
+    if (st.ops == 0) {
+        finish_close(conn);
+        return;
+    }
+
+    // pending receive and send are completed by the shutdown,
+    // the socket is closed when their completions come
+    shutdown(conn->sock_d, SHUT_RDWR);
+}
+
+ssize_t uring_reactor::read(connection *conn, char *buff, size_t size) noexcept
+{
+    uring_state& st = conn->uring;
+
+    size_t copied = 0;
+    while (copied < size && st.recv_head != -1) {
+        const uint16_t buff_id = static_cast<uint16_t>(st.recv_head);
+        const size_t buff_size = _buff_size[buff_id];
+
+        const size_t n = std::min(buff_size - st.recv_offset, size - copied);
+        std::memcpy(buff + copied, _ring.buffer(buff_id) + st.recv_offset, n);
+        copied += n;
+        st.recv_offset += n;
+
+        if (st.recv_offset == buff_size) {
+            st.recv_head = _buff_next[buff_id];
+            if (st.recv_head == -1) {
+                st.recv_tail = -1;
+            }
+            st.recv_offset = 0;
+            recycle_buffer(buff_id);
+        }
+    }
+
+    if (copied > 0) {
+        return static_cast<ssize_t>(copied);
+    }
+    if (st.recv_error != 0) {
+        errno = st.recv_error;
+        return -1;
+    }
+    if (st.recv_eof) {
+        return 0;
+    }
+
+    if (!st.recv_armed && !st.starved) {
+        arm_recv(conn);
+    }
+
+    errno = EAGAIN;
+    return -1;
+}
+
+ssize_t uring_reactor::send(connection *conn, const iovec *iov, size_t iov_num, bool more) noexcept
+{
+    uring_state& st = conn->uring;
+    if (st.send_done) {
+        return take_send_result(conn);
+    }
+
+    if (!st.send_inflight) {
+        int flags = MSG_NOSIGNAL;
+        if (more) {
+            flags |= MSG_MORE;
+        }
+
+        if (iov_num == 1) {
+            if (!submit_send(conn, iov[0].iov_base, iov[0].iov_len, flags)) {
+                errno = EBUSY;
+                return -1;
+            }
+        } else {
+            io_uring_sqe* sqe = _ring.get_sqe();
+            if (sqe == nullptr) {
+                errno = EBUSY;
+                return -1;
+            }
+
+            // the message must live until the completion
+            iov_num = std::min(iov_num, sizeof(st.send_iov) / sizeof(st.send_iov[0]));
+            std::copy(iov, iov + iov_num, st.send_iov);
+            st.send_msg = {};
+            st.send_msg.msg_iov = st.send_iov;
+            st.send_msg.msg_iovlen = iov_num;
+
+            sqe->opcode = IORING_OP_SENDMSG;
+            sqe->fd = conn->sock_d;
+            sqe->addr = reinterpret_cast<uint64_t>(&st.send_msg);
+            sqe->len = 1;
+            sqe->msg_flags = static_cast<uint32_t>(flags);
+            sqe->user_data = to_user_data(conn, op::send);
+
+            st.send_inflight = true;
+            ++st.ops;
+        }
+    }
+
+    errno = EAGAIN;
+    return -1;
+}
+
+ssize_t uring_reactor::sendfile(connection *conn, int file_d, off_t offset, size_t size) noexcept
+{
+    // there is no sendfile operation, so a file chunk is read into a buffer and sent then
+    uring_state& st = conn->uring;
+    if (st.send_done) {
+        return take_send_result(conn);
+    }
+
+    if (!st.send_inflight) {
+        io_uring_sqe* sqe = _ring.get_sqe();
+        if (sqe == nullptr) {
+            errno = EBUSY;
+            return -1;
+        }
+
+        if (st.file_buff == nullptr) {
+            st.file_buff = _file_buffers.acquire();
+        }
+
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = file_d;
+        sqe->addr = reinterpret_cast<uint64_t>(st.file_buff);
+        sqe->len = static_cast<uint32_t>(std::min(size, _file_buffers.buff_size()));
+        sqe->off = static_cast<uint64_t>(offset);
+        sqe->user_data = to_user_data(conn, op::file_read);
+
+        st.send_inflight = true;
+        ++st.ops;
+    }
+
+    errno = EAGAIN;
+    return -1;
+}
+
+void uring_reactor::handle_cqe(const io_uring_cqe &cqe) noexcept
+{
+    const op operation = static_cast<op>(cqe.user_data & 7);
+    connection* conn = reinterpret_cast<connection*>(cqe.user_data & ~uint64_t(7));
+
+    switch (operation) {
+    case op::accept:
+        handle_accept(cqe);
+        break;
+    case op::wake:
+        handle_wake(cqe);
+        break;
+    case op::recv:
+        handle_recv(conn, cqe);
+        break;
+    case op::send:
+        handle_send(conn, cqe.res);
+        break;
+    case op::file_read:
+        handle_file_read(conn, cqe.res);
+        break;
+    case op::none:
+        break;
+    }
+}
+
+void uring_reactor::handle_accept(const io_uring_cqe &cqe) noexcept
+{
+    if (!(cqe.flags & IORING_CQE_F_MORE)) {
+        const bool exhausted = cqe.res == -EMFILE || cqe.res == -ENFILE
+                || cqe.res == -ENOBUFS || cqe.res == -ENOMEM;
+        if (exhausted) {
+            _accept_resume_msecs = datetime::monotonic_msecs() + accept_pause_msecs;
+        } else {
+            arm_accept();
+        }
+    }
+
+    if (cqe.res >= 0) {
+        _handler->handle_accept(cqe.res);
+    } else if (cqe.res != -EAGAIN) {
+        LOG(ERROR) << "accept " << strerror(-cqe.res);
+    }
+}
+
+void uring_reactor::handle_wake(const io_uring_cqe &cqe) noexcept
+{
+    if (!(cqe.flags & IORING_CQE_F_MORE)) {
+        arm_wake();
+    }
+
+    _handler->handle_wake();
+}
+
+void uring_reactor::handle_recv(connection *conn, const io_uring_cqe &cqe) noexcept
+{
+    uring_state& st = conn->uring;
+
+    if (cqe.flags & IORING_CQE_F_BUFFER) {
+        const uint16_t buff_id = static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+        --_free_buffers;
+
+        if (cqe.res > 0 && !st.closing) {
+            _buff_next[buff_id] = -1;
+            _buff_size[buff_id] = static_cast<uint32_t>(cqe.res);
+            if (st.recv_tail != -1) {
+                _buff_next[st.recv_tail] = buff_id;
+            } else {
+                st.recv_head = buff_id;
+            }
+            st.recv_tail = buff_id;
+        } else {
+            recycle_buffer(buff_id);
+        }
+    }
+
+    if (cqe.res == 0) {
+        st.recv_eof = true;
+        // a connection which isn't read learns about the gone peer only by a hangup
+        if (conn->state == connection_state::wait_response
+                || conn->state == connection_state::wait_handler
+                || conn->state == connection_state::wait_body) {
+            conn->hangup = true;
+        }
+    } else if (cqe.res == -ENOBUFS) {
+        if (!st.closing && !st.starved) {
+            st.starved = true;
+            _starved.push_back(conn);
+        }
+    } else if (cqe.res < 0 && cqe.res != -EAGAIN && cqe.res != -ECANCELED) {
+        st.recv_error = -cqe.res;
+    }
+
+    const bool more = cqe.flags & IORING_CQE_F_MORE;
+    if (st.closing) {
+        if (!more) {
+            complete_op(conn);
+        }
+        return;
+    }
+    if (!more) {
+        st.recv_armed = false;
+        --st.ops;
+    }
+
+    if (cqe.res == -ENOBUFS || cqe.res == -EAGAIN) {
+        return;
+    }
+
+    conn->readable = true;
+    _handler->handle_event(conn);
+}
+
+void uring_reactor::handle_send(connection *conn, int res) noexcept
+{
+    uring_state& st = conn->uring;
+    st.send_inflight = false;
+
+    if (st.closing) {
+        complete_op(conn);
+        return;
+    }
+    --st.ops;
+
+    st.send_done = true;
+    st.send_result = res;
+
+    conn->writable = true;
+    _handler->handle_event(conn);
+}
+
+void uring_reactor::handle_file_read(connection *conn, int res) noexcept
+{
+    uring_state& st = conn->uring;
+
+    if (st.closing) {
+        st.send_inflight = false;
+        complete_op(conn);
+        return;
+    }
+    --st.ops;
+
+    if (res > 0) {
+        if (submit_send(conn, st.file_buff, static_cast<size_t>(res), MSG_NOSIGNAL)) {
+            return;
+        }
+        res = -EBUSY;
+    } else if (res == 0) {
+        // the file is shorter than the response says
+        res = -EIO;
+    }
+
+    st.send_inflight = false;
+    st.send_done = true;
+    st.send_result = res;
+
+    conn->writable = true;
+    _handler->handle_event(conn);
+}
+
+bool uring_reactor::probe_multishot_recv() noexcept
+{
+    int sds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sds) == -1) {
+        perror("socketpair");
+        return false;
+    }
+
+    io_uring_sqe* sqe = _ring.get_sqe();
+    if (sqe == nullptr) {
+        ::close(sds[0]);
+        ::close(sds[1]);
+        return false;
+    }
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = sds[0];
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = buffer_group;
+    sqe->user_data = to_user_data(nullptr, op::none);
+
+    const char byte = 0;
+    if (::write(sds[1], &byte, 1) == -1) {
+        perror("write socketpair");
+    }
+
+    // a supported receive stays armed after the byte, then the peer's close ends it
+    bool supported = false;
+    bool done = false;
+    for (int i=0; i<2 && !done; ++i) {
+        _ring.submit_and_wait(1000);
+        io_uring_cqe* cqe = _ring.peek_cqe();
+        if (cqe == nullptr) {
+            break;
+        }
+
+        const io_uring_cqe copy = *cqe;
+        _ring.cqe_seen();
+        if (copy.flags & IORING_CQE_F_BUFFER) {
+            _ring.recycle_buffer(static_cast<uint16_t>(copy.flags >> IORING_CQE_BUFFER_SHIFT));
+        }
+
+        if (i == 0) {
+            supported = copy.res > 0 && (copy.flags & IORING_CQE_F_MORE);
+            ::close(sds[1]);
+            sds[1] = -1;
+        }
+        done = !(copy.flags & IORING_CQE_F_MORE);
+    }
+
+    if (sds[1] != -1) {
+        ::close(sds[1]);
+    }
+    ::close(sds[0]);
+    return supported && done;
+}
+
+void uring_reactor::resume_accept() noexcept
+{
+    if (_accept_resume_msecs == -1 || datetime::monotonic_msecs() < _accept_resume_msecs) {
+        return;
+    }
+
+    _accept_resume_msecs = -1;
+    arm_accept();
+}
+
+bool uring_reactor::arm_accept() noexcept
+{
+    io_uring_sqe* sqe = _ring.get_sqe();
+    if (sqe == nullptr) {
+        LOG(ERROR) << "io_uring submission queue is full";
+        return false;
+    }
+
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = _listen_d;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_CLOEXEC;
+    sqe->user_data = to_user_data(nullptr, op::accept);
+    return true;
+}
+
+bool uring_reactor::arm_wake() noexcept
+{
+    io_uring_sqe* sqe = _ring.get_sqe();
+    if (sqe == nullptr) {
+        LOG(ERROR) << "io_uring submission queue is full";
+        return false;
+    }
+
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = _wake_d;
+    sqe->poll32_events = POLLIN;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->user_data = to_user_data(nullptr, op::wake);
+    return true;
+}
+
+bool uring_reactor::arm_recv(connection *conn) noexcept
+{
+    io_uring_sqe* sqe = _ring.get_sqe();
+    if (sqe == nullptr) {
+        LOG(ERROR) << "io_uring submission queue is full";
+        return false;
+    }
+
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = conn->sock_d;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = buffer_group;
+    sqe->user_data = to_user_data(conn, op::recv);
+
+    conn->uring.recv_armed = true;
+    ++conn->uring.ops;
+    return true;
+}
+
+bool uring_reactor::submit_send(connection *conn, const void *buff, size_t size, int flags) noexcept
+{
+    io_uring_sqe* sqe = _ring.get_sqe();
+    if (sqe == nullptr) {
+        return false;
+    }
+
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = conn->sock_d;
+    sqe->addr = reinterpret_cast<uint64_t>(buff);
+    sqe->len = static_cast<uint32_t>(std::min<size_t>(size, UINT32_MAX));
+    sqe->msg_flags = static_cast<uint32_t>(flags);
+    sqe->user_data = to_user_data(conn, op::send);
+
+    conn->uring.send_inflight = true;
+    ++conn->uring.ops;
+    return true;
+}
+
+void uring_reactor::rearm_starved() noexcept
+{
+    if (_starved.empty() || _free_buffers == 0) {
+        return;
+    }
+
+    std::vector<connection*> starved;
+    starved.swap(_starved);
+
+    for (connection* conn : starved) {
+        uring_state& st = conn->uring;
+        st.starved = false;
+        if (!st.recv_armed && !st.recv_eof && st.recv_error == 0) {
+            arm_recv(conn);
+        }
+    }
+}
+
+ssize_t uring_reactor::take_send_result(connection *conn) noexcept
+{
+    uring_state& st = conn->uring;
+    st.send_done = false;
+
+    if (st.file_buff != nullptr) {
+        _file_buffers.release(st.file_buff);
+        st.file_buff = nullptr;
+    }
+
+    if (st.send_result < 0) {
+        errno = -st.send_result;
+        return -1;
+    }
+    return st.send_result;
+}
+
+void uring_reactor::recycle_received(connection *conn) noexcept
+{
+    uring_state& st = conn->uring;
+    while (st.recv_head != -1) {
+        const uint16_t buff_id = static_cast<uint16_t>(st.recv_head);
+        st.recv_head = _buff_next[buff_id];
+        recycle_buffer(buff_id);
+    }
+    st.recv_tail = -1;
+    st.recv_offset = 0;
+}
+
+void uring_reactor::recycle_buffer(uint16_t buff_id) noexcept
+{
+    _ring.recycle_buffer(buff_id);
+    ++_free_buffers;
+}
+
+void uring_reactor::complete_op(connection *conn) noexcept
+{
+    // the last completion of a closing connection releases it
+    uring_state& st = conn->uring;
+    --st.ops;
+    if (st.ops == 0) {
+        finish_close(conn);
+    }
+}
+
+void uring_reactor::finish_close(connection *conn) noexcept
+{
+    uring_state& st = conn->uring;
+    if (st.file_buff != nullptr) {
+        _file_buffers.release(st.file_buff);
+        st.file_buff = nullptr;
+    }
+
+    ::close(conn->sock_d);
+    _handler->handle_closed(conn);
+}
+
+uint64_t uring_reactor::to_user_data(connection *conn, op operation) noexcept
+{
+    return reinterpret_cast<uint64_t>(conn) | static_cast<uint64_t>(operation);
+}
@@ -0,0 +1,103 @@
+#ifndef URING_REACTOR_H
+#define URING_REACTOR_H
+
+#include <vector>
+
+#include "reactor.h"
+#include "uring.h"
+#include "buffer_pool.h"
+
+namespace http {
+
+// Completion based reactor. The listening socket is accepted by multishot accept,
+// sockets are received by multishot receive into a ring of provided buffers
+// and sends are submitted asynchronously, so one io_uring_enter per loop turn
+// both submits and reaps all operations.
+class uring_reactor : public reactor
+{
+public:
+    uring_reactor(reactor_handler* handler, const server_config& config) noexcept;
+    ~uring_reactor() override;
+
+    bool init(int listen_d, int wake_d) noexcept override;
+    void wait(int timeout_msecs) noexcept override;
+    void dispatch() noexcept override;
+    bool edge_triggered() const noexcept override;
+
+    bool open(connection* conn) noexcept override;
+    bool watch(connection* conn) noexcept override;
+    void close(connection* conn) noexcept override;
+
+    ssize_t read(connection* conn, char* buff, size_t size) noexcept override;
+    ssize_t send(connection* conn, const iovec* iov, size_t iov_num, bool more) noexcept override;
+    ssize_t sendfile(connection* conn, int file_d, off_t offset, size_t size) noexcept override;
+
+private:
+    enum class op : uint64_t
+    {
+        none,
+        accept,
+        wake,
+        recv,
+        send,
+        file_read
+    };
+
+    void handle_cqe(const io_uring_cqe& cqe) noexcept;
+    void handle_accept(const io_uring_cqe& cqe) noexcept;
+    void handle_wake(const io_uring_cqe& cqe) noexcept;
+    void handle_recv(connection* conn, const io_uring_cqe& cqe) noexcept;
+    void handle_send(connection* conn, int res) noexcept;
+    void handle_file_read(connection* conn, int res) noexcept;
+
+    // multishot receive came in 6.0, a ring of an older kernel fails every receive
+    bool probe_multishot_recv() noexcept;
+    void resume_accept() noexcept;
+
+    bool arm_accept() noexcept;
+    bool arm_wake() noexcept;
+    bool arm_recv(connection* conn) noexcept;
+    bool submit_send(connection* conn, const void* buff, size_t size, int flags) noexcept;
+    void rearm_starved() noexcept;
+
+    // the connection gets its send result by the next send or sendfile
+    ssize_t take_send_result(connection* conn) noexcept;
+    void recycle_received(connection* conn) noexcept;
+    void recycle_buffer(uint16_t buff_id) noexcept;
+
+    // an operation of a closing connection is completed
+    void complete_op(connection* conn) noexcept;
+    void finish_close(connection* conn) noexcept;
+
+    static uint64_t to_user_data(connection* conn, op operation) noexcept;
+
+private:
+    static const uint16_t buffer_group = 0;
+
+    reactor_handler* _handler = nullptr;
+
+    unsigned _entries = 0;
+    unsigned _buffers_num = 0;
+    size_t _buffer_size = 0;
+
+    int _listen_d = -1;
+    int _wake_d = -1;
+    // accepting is paused till then, -1 if it isn't
+    int64_t _accept_resume_msecs = -1;
+
+    uring _ring;
+
+    // received buffers of a connection are linked by buffer ids
+    std::vector<int32_t> _buff_next;
+    std::vector<uint32_t> _buff_size;
+    size_t _free_buffers = 0;
+    // connections waiting for free buffers to receive again
+    std::vector<connection*> _starved;
+
+    // file bodies are read here and sent then
+    buffer_pool _file_buffers;
+};
+
+}
+
+#endif // URING_REACTOR_H
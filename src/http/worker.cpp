@@ -1,19 +1,40 @@
 #include "worker.h"
 
 #include <cassert>
+#include <algorithm>
 
-#include <sys/epoll.h>
-#include <sys/sendfile.h>
+#include <unistd.h>
 #include <glog/logging.h>
 
 #include "connection.h"
+#include "../utility/datetime.h"
 
 using namespace http;
 
-// TODO: 408 Request Timeout
-
-worker::worker(int epoll_d) noexcept :
-    _epoll_d(epoll_d)
+worker::worker(int listen_d,
+               const server_config& config,
+               file_cache* files,
+               compressor* compression,
+               request_handler request_handl,
+               uri_handler uri_hand,
+               header_handler header_hand,
+               body_handler body_hand,
+               async_request_handler async_request_handl) noexcept :
+    _listen_d(listen_d),
+    _config(config),
+    _files(files),
+    _compressor(compression),
+    _request_handler(request_handl),
+    _uri_handler(uri_hand),
+    _header_handler(header_hand),
+    _body_handler(body_hand),
+    _async_request_handler(async_request_handl),
+    _now(datetime::monotonic_msecs()),
+    _timers(_now),
+    _buffers(config.io_buffer_size, config.io_buffer_pool_size, config.io_buffer_huge_pages),
+    _connections(config.connection_pool_size),
+    _request_state_machines(config.request_state_machine_pool_size),
+    _response_readers(config.response_reader_pool_size)
 {
     _isRuning.store(false);
 }
@@ -21,53 +42,304 @@ worker::worker(int epoll_d) noexcept :
 worker::~worker()
 {
     stop();
+
+    // the mailbox and its eventfd go with the last handle
+    _reactor.reset();
+    _mailbox.reset();
 }
 
-void worker::start() noexcept
+bool worker::start() noexcept
 {
-    LOG(INFO) << "Listen " << _epoll_d;
+    // sockets accepted by the server thread and async responses come through the eventfd
+    _mailbox = std::make_shared<completion_mailbox>();
+    if (!_mailbox->init()) {
+        return false;
+    }
+    _wake_d = _mailbox->wake_d();
+
+    _reactor = make_reactor(_config, this, _listen_d, _wake_d);
+    if (!_reactor) {
+        return false;
+    }
+
     _isRuning.store(true);
     _thread = std::thread(&worker::loop, this);
+
+    return true;
 }
 
 void worker::stop() noexcept
 {
-    _isRuning.store(true);
+    _isRuning.store(false);
     if (_thread.joinable()) {
+        // the loop can sleep in wait for a long timeout
+        _mailbox->wake();
         _thread.join();
     }
+
+    // the responses which are still coming are dropped
+    if (_mailbox) {
+        _mailbox->close();
+    }
 }
 
 void worker::loop() noexcept
 {
-    const int timeout_msecs = 30000;
-    const size_t max_events = 1000;
-    epoll_event events[max_events];
-
+    const int max_timeout_msecs = 30000;
     while (_isRuning) {
-        int num_conns = epoll_wait(_epoll_d, events, max_events, timeout_msecs);
-        for (int i = 0; i < num_conns; ++i) {
-            const epoll_event& event = events[i];
-            connection* conn = reinterpret_cast<connection*>(event.data.ptr);
-            if (event.events&EPOLLRDHUP) {
-                go_close_connection(conn);
-            } else if (event.events&EPOLLIN) {
-                handle_in(conn);
-                if (conn->state == connection_state::write_response) {
-                    epoll_event event;
-                    event.events = EPOLLOUT | EPOLLRDHUP;
-                    event.data.ptr = conn;
-                    if (epoll_ctl(_epoll_d, EPOLL_CTL_MOD, conn->sock_d, &event) == -1) {
-                        perror("epoll_ctl mod");
-                        go_close_connection(conn);
-                    }
-                }
-            } else if (event.events&EPOLLOUT) {
-                handle_out(conn);
-            } else {
-                assert(false);
-            }
+        int timeout_msecs = _timers.next_timeout(datetime::monotonic_msecs());
+        if (timeout_msecs == -1 || timeout_msecs > max_timeout_msecs) {
+            timeout_msecs = max_timeout_msecs;
         }
+        // don't sleep while connections wait for the next turn
+        if (_queue_head != nullptr) {
+            timeout_msecs = 0;
+        }
+
+        _reactor->wait(timeout_msecs);
+        _now = datetime::monotonic_msecs();
+        _headers.update(datetime::unix_timestamp());
+
+        // the connections queued on the previous turns go first
+        handle_queue();
+
+        _reactor->dispatch();
+
+        handle_timers();
+    }
+
+    close_connections();
+}
+
+void worker::add_connection(int sock_d) noexcept
+{
+    {
+        std::lock_guard<std::mutex> lock(_pending_mutex);
+        _pending_socks.push_back(sock_d);
+    }
+
+    _mailbox->wake();
+}
+
+worker_stats worker::stats() const noexcept
+{
+    worker_stats res;
+    res.connections = _connections.stats();
+    res.request_state_machines = _request_state_machines.stats();
+    res.response_readers = _response_readers.stats();
+    res.io_buffers = _buffers.stats();
+    return res;
+}
+
+void worker::open_connection(int sock_d) noexcept
+{
+    connection* conn = _connections.acquire();
+    conn->sock_d = sock_d;
+    conn->req_handler = _request_handler;
+    conn->req_state_machine = _request_state_machines.make(_uri_handler, _header_handler, &_buffers,
+                                                         _body_handler, _config.body_chunk_size);
+    conn->resp_reader = _response_readers.make();
+    conn->timer.data = conn;
+
+    if (_body_handler) {
+        conn->body_handle = std::make_shared<connection_handle>();
+        conn->body_handle->mailbox = _mailbox;
+        conn->body_handle->conn = conn;
+        conn->body_handle->body = true;
+        conn->req_state_machine->set_body_token(body_token(conn->body_handle));
+    }
+
+    if (!_reactor->open(conn)) {
+        close(sock_d);
+        _connections.release(conn);
+        return;
+    }
+
+    conn->open_next = _open_head;
+    if (_open_head != nullptr) {
+        _open_head->open_prev = conn;
+    }
+    _open_head = conn;
+
+    arm_read_timer(conn);
+}
+
+void worker::close_connections() noexcept
+{
+    {
+        std::lock_guard<std::mutex> lock(_pending_mutex);
+        for (int sock_d : _pending_socks) {
+            close(sock_d);
+        }
+        _pending_socks.clear();
+    }
+
+    connection* conn = _open_head;
+    while (conn != nullptr) {
+        connection* next = conn->open_next;
+        go_close_connection(conn);
+        conn = next;
+    }
+
+    // io_uring releases a connection when the completions of its operations come
+    const int64_t deadline_msecs = datetime::monotonic_msecs() + 1000;
+    while (_open_head != nullptr && datetime::monotonic_msecs() < deadline_msecs) {
+        _reactor->wait(10);
+        _reactor->dispatch();
+    }
+}
+
+void worker::handle_accept(int sock_d) noexcept
+{
+    if (!_isRuning) {
+        close(sock_d);
+        return;
+    }
+    open_connection(sock_d);
+}
+
+void worker::handle_wake() noexcept
+{
+    uint64_t value = 0;
+    if (read(_wake_d, &value, sizeof(value)) == -1 && errno != EAGAIN) {
+        perror("read eventfd");
+    }
+
+    std::vector<int> socks;
+    {
+        std::lock_guard<std::mutex> lock(_pending_mutex);
+        socks.swap(_pending_socks);
+    }
+
+    for (int sock_d : socks) {
+        if (_isRuning) {
+            open_connection(sock_d);
+        } else {
+            close(sock_d);
+        }
+    }
+
+    completion* item = _mailbox->take();
+    while (item != nullptr) {
+        completion* next = item->next;
+        handle_completion(*item);
+        delete item;
+        item = next;
+    }
+}
+
+void worker::handle_event(connection *conn) noexcept
+{
+    if (conn->hangup) {
+        go_close_connection(conn);
+        return;
+    }
+    if (conn->queued) {
+        // it will be handled in its turn
+        return;
+    }
+
+    handle_ready(conn);
+}
+
+void worker::handle_closed(connection *conn) noexcept
+{
+    if (conn->open_prev != nullptr) {
+        conn->open_prev->open_next = conn->open_next;
+    } else if (_open_head == conn) {
+        _open_head = conn->open_next;
+    }
+    if (conn->open_next != nullptr) {
+        conn->open_next->open_prev = conn->open_prev;
+    }
+
+    _connections.release(conn);
+}
+
+void worker::handle_ready(connection *conn) noexcept
+{
+    switch (conn->state) {
+    case connection_state::read_request:
+        if (conn->readable) {
+            handle_in(conn);
+        }
+        break;
+    case connection_state::write_response:
+        if (conn->writable) {
+            handle_out(conn);
+        }
+        break;
+    case connection_state::wait_response:
+        // the producer is polled by the timer
+        break;
+    case connection_state::wait_handler:
+        // the response comes through the mailbox
+        break;
+    case connection_state::wait_body:
+        // the resume comes through the mailbox
+        break;
+    case connection_state::read_response:
+    case connection_state::write_request:
+        assert(false);
+        break;
+    }
+}
+
+void worker::handle_queue() noexcept
+{
+    // connections queued while the queue is handled wait for the next turn
+    connection* tail = _queue_tail;
+    while (_queue_head != nullptr) {
+        connection* conn = _queue_head;
+        dequeue(conn);
+
+        handle_ready(conn);
+
+        if (conn == tail) {
+            break;
+        }
+    }
+}
+
+void worker::handle_timers() noexcept
+{
+    timer_node* node = _timers.advance(_now);
+    while (node != nullptr) {
+        // a handler can schedule the node again
+        timer_node* next = node->next;
+        handle_timeout(reinterpret_cast<connection*>(node->data));
+        node = next;
+    }
+}
+
+void worker::handle_timeout(connection *conn) noexcept
+{
+    switch (conn->timer_kind) {
+    case connection_timer::header:
+    case connection_timer::body: {
+        response resp;
+        resp.code = 408;
+        go_write_response(conn, std::move(resp));
+        handle_out(conn);
+        break;
+    }
+    case connection_timer::produce:
+        conn->state = connection_state::write_response;
+        handle_out(conn);
+        break;
+    case connection_timer::handler: {
+        go_cancel_handler(conn);
+        response resp;
+        resp.code = 504;
+        go_write_response(conn, std::move(resp));
+        handle_out(conn);
+        break;
+    }
+    case connection_timer::idle:
+    case connection_timer::write:
+    case connection_timer::none:
+        go_close_connection(conn);
+        break;
     }
 }
 
@@ -79,24 +351,156 @@ void worker::handle_in(connection *conn) noexcept
 
     auto&& req_state_machine = conn->req_state_machine;
 
+    size_t reads_num = 0;
     while (req_state_machine->get_state() == request_state_machine::state::processing) {
+        if (req_state_machine->paused()) {
+            go_wait_body(conn);
+            return;
+        }
+        if (reads_num >= _config.read_budget) {
+            arm_read_timer(conn);
+            go_wait_turn(conn);
+            return;
+        }
+
         auto [buff, size] = req_state_machine->prepare_buff();
         if (size > 0) {
-            const ssize_t s_read_size = read(conn->sock_d, buff, size);
+            const ssize_t s_read_size = _reactor->read(conn, buff, size);
+            ++reads_num;
             if (s_read_size > 0) {
                 req_state_machine->process_buff(static_cast<size_t>(s_read_size));
             } else if (s_read_size == -1 && errno == EAGAIN) {
+                conn->readable = false;
+                arm_read_timer(conn);
+                return;
+            } else if (s_read_size == 0) {
+                // the client has closed a persistent connection
+                go_close_connection(conn);
                 return;
             } else {
                 perror("read request");
                 response resp;
                 resp.code = 500;
-                go_write_response(conn, resp);
+                go_write_response(conn, std::move(resp));
+                handle_out(conn);
                 return;
             }
         }
     }
 
+    if (handle_request(conn)) {
+        handle_out(conn);
+    }
+}
+
+void worker::handle_out(connection *conn) noexcept
+{
+    if (conn->state != connection_state::write_response) {
+        LOG(WARNING) << "try handle out but it's incorect state";
+    }
+
+    auto&& resp_reader = conn->resp_reader;
+
+    size_t budget = _config.write_budget;
+
+    // pipelined requests are answered one after another without waiting for the reactor
+    while (true) {
+        while (resp_reader->has_chunks() && budget > 0) {
+            if (!resp_reader->produce()) {
+                if (resp_reader->aborted()) {
+                    go_close_connection(conn);
+                } else {
+                    go_wait_producer(conn);
+                }
+                return;
+            }
+
+            ssize_t written = -1;
+
+            // the header and an in-memory body go by one call
+            iovec iov[send_iovecs_num];
+            size_t iov_num = resp_reader->get_iovecs(iov, send_iovecs_num);
+            if (iov_num > 0) {
+                size_t size = 0;
+                for (size_t i=0; i<iov_num; ++i) {
+                    if (size + iov[i].iov_len >= budget) {
+                        iov[i].iov_len = budget - size;
+                        iov_num = i + 1;
+                    }
+                    size += iov[i].iov_len;
+                }
+
+                // the header of a file body is coalesced with the first sendfile segment
+                written = _reactor->send(conn, iov, iov_num, resp_reader->has_file_chunk());
+            } else {
+                response_chunk chunk = resp_reader->get_chunk();
+                if (chunk.file_d != -1) {
+                    size_t size = std::min(chunk.size, budget);
+                    written = _reactor->sendfile(conn, chunk.file_d, chunk.file_offset, size);
+                } else {
+                    assert(1);
+                }
+            }
+
+            if (written > 0) {
+                resp_reader->next(static_cast<size_t>(written));
+                budget -= static_cast<size_t>(written);
+            } else if (written == -1 && errno == EAGAIN) {
+                conn->writable = false;
+                break;
+            } else {
+                perror("write response");
+                go_close_connection(conn);
+                return;
+            }
+        }
+
+        if (resp_reader->has_chunks()) {
+            if (_reactor->watch(conn)) {
+                arm_timer(conn, connection_timer::write);
+                if (conn->writable) {
+                    go_wait_turn(conn);
+                }
+            } else {
+                go_close_connection(conn);
+            }
+            return;
+        }
+
+        if (!conn->keep_alive) {
+            go_close_connection(conn);
+            return;
+        }
+
+        go_read_request(conn);
+        if (conn->req_state_machine->paused()) {
+            // the pipelined bytes have been given to the body handler
+            go_wait_body(conn);
+            return;
+        }
+        if (conn->req_state_machine->get_state() == request_state_machine::state::processing) {
+            if (_reactor->watch(conn)) {
+                arm_read_timer(conn);
+                // the edge of the next request could come while the response was written
+                if (conn->readable) {
+                    go_wait_turn(conn);
+                }
+            } else {
+                go_close_connection(conn);
+            }
+            return;
+        }
+
+        if (!handle_request(conn)) {
+            return;
+        }
+    }
+}
+
+bool worker::handle_request(connection *conn) noexcept
+{
+    auto&& req_state_machine = conn->req_state_machine;
+
     switch(req_state_machine->get_state()) {
     case request_state_machine::state::processing: {
         break;
@@ -104,61 +508,298 @@ void worker::handle_in(connection *conn) noexcept
     case request_state_machine::state::rejected: {
         response resp;
         resp.code = req_state_machine->get_rejected_code();
-        go_write_response(conn, resp);
+        go_write_response(conn, std::move(resp));
         break;
     }
     case request_state_machine::state::accpeted: {
-        response resp = conn->req_handler(req_state_machine->get_request());
-        go_write_response(conn, resp);
+        if (_async_request_handler) {
+            return go_wait_handler(conn);
+        }
+
+        return go_encode_response(conn, conn->req_handler(req_state_machine->get_request()));
+    }
+    }
+    return true;
+}
+
+void worker::handle_completion(completion &item) noexcept
+{
+    connection* conn = item.handle->conn;
+    if (conn == nullptr) {
+        // the connection is closed or the handler has timed out
+        return;
+    }
+
+    if (item.handle->body) {
+        // a resume without a pause is dropped
+        if (conn->state == connection_state::wait_body) {
+            go_resume_body(conn);
+        }
+        return;
+    }
+
+    item.handle->conn = nullptr;
+    conn->handle.reset();
+
+    if (item.handle->encoded) {
+        go_write_response(conn, std::move(item.resp));
+        handle_out(conn);
+    } else if (go_encode_response(conn, std::move(item.resp))) {
+        handle_out(conn);
+    }
+}
+
+void worker::go_read_request(connection *conn) noexcept
+{
+    _timers.cancel(&conn->timer);
+    conn->timer_kind = connection_timer::none;
+
+    // the pipelined bytes can already contain the next request
+    conn->req_state_machine->reset();
+    conn->state = connection_state::read_request;
+}
+
+void worker::go_write_response(connection *conn, response &&resp) noexcept
+{
+    auto&& req_state_machine = conn->req_state_machine;
+
+    ++conn->requests_num;
+    conn->keep_alive = req_state_machine->get_state() == request_state_machine::state::accpeted
+            && req_state_machine->keep_alive()
+            && conn->requests_num < _config.keep_alive_max_requests;
+
+    conn->resp_reader->reset(std::move(resp), req_state_machine->get_request().get(), conn->keep_alive, _headers, *_files);
+    conn->state = connection_state::write_response;
+}
+
+bool worker::go_encode_response(connection *conn, response &&resp) noexcept
+{
+    if (_compressor == nullptr) {
+        go_write_response(conn, std::move(resp));
+        return true;
+    }
+
+    response encoded;
+    content_encoding encoding = content_encoding::identity;
+    switch (_compressor->encode(conn->req_state_machine->get_request().get(), resp, encoded, encoding)) {
+    case compressor::result::as_is:
+        go_write_response(conn, std::move(resp));
+        return true;
+    case compressor::result::encoded:
+        go_write_response(conn, std::move(encoded));
+        return true;
+    case compressor::result::offload:
         break;
     }
+
+    // the encoded response comes like the one of an async handler
+    std::shared_ptr<connection_handle> handle = attach_handle(conn);
+    handle->encoded = true;
+    _compressor->encode_later(*conn->req_state_machine->get_request(), std::move(resp), encoding,
+                              completion_token(handle));
+    go_wait_completion(conn);
+    return false;
+}
+
+void worker::go_wait_turn(connection *conn) noexcept
+{
+    // level-triggered epoll reports the socket again by itself
+    if (_reactor->edge_triggered()) {
+        enqueue(conn);
+    }
+}
+
+void worker::go_wait_producer(connection *conn) noexcept
+{
+    // the socket isn't watched for writing till the producer is called again
+    conn->state = connection_state::wait_response;
+    if (!_reactor->watch(conn)) {
+        go_close_connection(conn);
+        return;
     }
+
+    arm_timer(conn, connection_timer::produce);
 }
 
-void worker::handle_out(connection *conn) noexcept
+bool worker::go_wait_handler(connection *conn) noexcept
 {
-    if (conn->state != connection_state::write_response) {
-        LOG(WARNING) << "try handle out but it's incorect state";
+    std::shared_ptr<connection_handle> handle = attach_handle(conn);
+
+    // the handler can keep the request after a timeout or a hangup,
+    // then the receive buffer is reused or released
+    conn->req_state_machine->get_request()->header_fields.detach();
+    {
+        completion_scope scope(handle.get());
+        _async_request_handler(conn->req_state_machine->get_request(), completion_token(handle));
     }
 
-    auto&& resp_reader = conn->resp_reader;
+    // a handler which isn't offloaded completes right away
+    if (handle->completed_inline) {
+        handle->conn = nullptr;
+        conn->handle.reset();
+        return go_encode_response(conn, std::move(handle->inline_resp));
+    }
 
-    while (resp_reader->has_chunks()) {
-        response_chunk chunk = resp_reader->get_chunk();
+    go_wait_completion(conn);
+    return false;
+}
 
-        ssize_t written = -1;
-        if (chunk.buff != nullptr) {
-            written = write(conn->sock_d, chunk.buff, chunk.size);
-        } else if (chunk.file_d != -1) {
-            written = sendfile(conn->sock_d, chunk.file_d, &chunk.file_offset, chunk.size);
-        } else {
-            assert(1);
-        }
+void worker::go_wait_completion(connection *conn) noexcept
+{
+    // only a hangup is watched while the handler works,
+    // the completion can't come before the worker takes its mailbox
+    conn->state = connection_state::wait_handler;
+    _reactor->watch(conn);
+    arm_timer(conn, connection_timer::handler);
+}
 
-        if (written > 0) {
-            resp_reader->next(static_cast<size_t>(written));
-        } else if (written == -1 && errno == EAGAIN) {
-            break;
-        } else {
-            perror("write response");
-            go_close_connection(conn);
-            break;
-        }
+void worker::go_wait_body(connection *conn) noexcept
+{
+    // the socket isn't read till the body handler resumes the body,
+    // so the client is slowed down by the flow control of TCP
+    conn->state = connection_state::wait_body;
+    if (!_reactor->watch(conn)) {
+        go_close_connection(conn);
+        return;
     }
 
-    if (!resp_reader->has_chunks()) {
+    arm_timer(conn, connection_timer::handler);
+}
+
+void worker::go_resume_body(connection *conn) noexcept
+{
+    conn->req_state_machine->resume();
+    conn->state = connection_state::read_request;
+    if (!_reactor->watch(conn)) {
         go_close_connection(conn);
+        return;
     }
+
+    arm_read_timer(conn);
+    handle_in(conn);
 }
 
-void worker::go_write_response(connection *conn, const response& resp) noexcept
+void worker::go_cancel_handler(connection *conn) noexcept
 {
-    conn->resp_reader = std::make_unique<response_reader>(resp);
-    conn->state = connection_state::write_response;
+    if (!conn->handle) {
+        return;
+    }
+
+    conn->handle->conn = nullptr;
+    conn->handle->cancelled.store(true);
+    conn->handle.reset();
 }
 
 void worker::go_close_connection(connection *conn) noexcept
 {
-    close(conn->sock_d);
-    delete conn;
+    go_cancel_handler(conn);
+    if (conn->body_handle) {
+        conn->body_handle->conn = nullptr;
+        conn->body_handle->cancelled.store(true);
+        conn->body_handle.reset();
+    }
+    dequeue(conn);
+    _timers.cancel(&conn->timer);
+    // the connection is released by handle_closed
+    _reactor->close(conn);
+}
+
+std::shared_ptr<connection_handle> worker::attach_handle(connection *conn) noexcept
+{
+    auto handle = std::make_shared<connection_handle>();
+    handle->mailbox = _mailbox;
+    handle->conn = conn;
+    conn->handle = handle;
+    return handle;
+}
+
+void worker::arm_read_timer(connection *conn) noexcept
+{
+    auto&& req_state_machine = conn->req_state_machine;
+
+    if (req_state_machine->reading_body()) {
+        // a body timeout is counted from the last progress
+        arm_timer(conn, connection_timer::body);
+    } else if (req_state_machine->has_data() || conn->requests_num == 0) {
+        // a header timeout is counted from the first byte of a request
+        if (conn->timer_kind != connection_timer::header) {
+            arm_timer(conn, connection_timer::header);
+        }
+    } else if (conn->timer_kind != connection_timer::idle) {
+        arm_timer(conn, connection_timer::idle);
+    }
+}
+
+void worker::arm_timer(connection *conn, connection_timer kind) noexcept
+{
+    int64_t timeout = 0;
+    switch (kind) {
+    case connection_timer::header:
+        timeout = _config.header_timeout;
+        break;
+    case connection_timer::body:
+        timeout = _config.body_timeout;
+        break;
+    case connection_timer::idle:
+        timeout = _config.keep_alive_timeout;
+        break;
+    case connection_timer::write:
+        timeout = _config.write_timeout;
+        break;
+    case connection_timer::produce:
+        timeout = std::max<int64_t>(_config.producer_poll_interval, 1);
+        break;
+    case connection_timer::handler:
+        timeout = _config.handler_timeout;
+        break;
+    case connection_timer::none:
+        break;
+    }
+
+    conn->timer_kind = kind;
+    if (timeout > 0) {
+        _timers.schedule(&conn->timer, _now + timeout);
+    } else {
+        _timers.cancel(&conn->timer);
+    }
+}
+
+void worker::enqueue(connection *conn) noexcept
+{
+    if (conn->queued) {
+        return;
+    }
+
+    conn->queue_prev = _queue_tail;
+    conn->queue_next = nullptr;
+    if (_queue_tail != nullptr) {
+        _queue_tail->queue_next = conn;
+    } else {
+        _queue_head = conn;
+    }
+    _queue_tail = conn;
+
+    conn->queued = true;
+}
+
+void worker::dequeue(connection *conn) noexcept
+{
+    if (!conn->queued) {
+        return;
+    }
+
+    if (conn->queue_prev != nullptr) {
+        conn->queue_prev->queue_next = conn->queue_next;
+    } else {
+        _queue_head = conn->queue_next;
+    }
+    if (conn->queue_next != nullptr) {
+        conn->queue_next->queue_prev = conn->queue_prev;
+    } else {
+        _queue_tail = conn->queue_prev;
+    }
+
+    conn->queue_prev = nullptr;
+    conn->queue_next = nullptr;
+    conn->queued = false;
 }
@@ -2,37 +2,138 @@
 #define WORKER_H
 
 #include <string>
+#include <vector>
 #include <thread>
 #include <atomic>
+#include <mutex>
+#include <memory>
 
 #include "response.h"
+#include "handlers.h"
+#include "server_config.h"
+#include "reactor.h"
+#include "timer_wheel.h"
+#include "object_pool.h"
+#include "buffer_pool.h"
+#include "header_cache.h"
+#include "stats.h"
+#include "completion.h"
+#include "file_cache.h"
+#include "compression.h"
 
 namespace http {
 
 struct connection;
+enum class connection_timer;
+class request_state_machine;
+class response_reader;
 
-class worker
+class worker : public reactor_handler
 {
 public:
-    worker(int epoll_d) noexcept;
-    ~worker();
+    // listen_d is a nonblocking listening socket owned by the worker or -1,
+    // the file cache and the compressor are shared by the workers of a server
+    worker(int listen_d,
+           const server_config& config,
+           file_cache* files,
+           compressor* compression,
+           request_handler request_handl,
+           uri_handler uri_hand,
+           header_handler header_hand,
+           body_handler body_hand = nullptr,
+           async_request_handler async_request_handl = nullptr) noexcept;
+    ~worker() override;
 
-    void start() noexcept;
+    bool start() noexcept;
     void stop() noexcept;
 
+    // hands an accepted socket over to the worker thread
+    void add_connection(int sock_d) noexcept;
+
+    // can be called from any thread
+    worker_stats stats() const noexcept;
+
 private:
     void loop() noexcept;
 
+    void open_connection(int sock_d) noexcept;
+    // closes the open and pending connections when the loop ends
+    void close_connections() noexcept;
+
+    void handle_accept(int sock_d) noexcept override;
+    void handle_wake() noexcept override;
+    void handle_event(connection* conn) noexcept override;
+    void handle_closed(connection* conn) noexcept override;
+    void handle_ready(connection* conn) noexcept;
+    void handle_queue() noexcept;
+    void handle_timers() noexcept;
+    void handle_timeout(connection* conn) noexcept;
     void handle_in(connection* conn) noexcept;
     void handle_out(connection* conn) noexcept;
+    // returns false if the response isn't ready to be written
+    bool handle_request(connection* conn) noexcept;
+    void handle_completion(completion& item) noexcept;
 
-    void go_write_response(connection* conn, const response &resp) noexcept;
+    void go_read_request(connection* conn) noexcept;
+    // responses are moved all the way to the reader
+    void go_write_response(connection* conn, response&& resp) noexcept;
+    // returns false if the body is compressed on the executor
+    bool go_encode_response(connection* conn, response&& resp) noexcept;
+    void go_wait_turn(connection* conn) noexcept;
+    void go_wait_producer(connection* conn) noexcept;
+    // returns true if the handler has completed right away
+    bool go_wait_handler(connection* conn) noexcept;
+    void go_wait_completion(connection* conn) noexcept;
+    void go_wait_body(connection* conn) noexcept;
+    void go_resume_body(connection* conn) noexcept;
+    // the late response of the async handler is dropped
+    void go_cancel_handler(connection* conn) noexcept;
     void go_close_connection(connection* conn) noexcept;
 
+    std::shared_ptr<connection_handle> attach_handle(connection* conn) noexcept;
+
+    void arm_read_timer(connection* conn) noexcept;
+    void arm_timer(connection* conn, connection_timer kind) noexcept;
+
+    void enqueue(connection* conn) noexcept;
+    void dequeue(connection* conn) noexcept;
+
 private:
-    int _epoll_d = -1;
+    int _listen_d = -1;
+    int _wake_d = -1;
+    server_config _config;
+    file_cache* _files = nullptr;
+    compressor* _compressor = nullptr;
+    std::unique_ptr<reactor> _reactor;
     std::atomic<bool> _isRuning;
     std::thread _thread;
+
+    request_handler _request_handler;
+    uri_handler _uri_handler;
+    header_handler _header_handler;
+    body_handler _body_handler;
+    async_request_handler _async_request_handler;
+
+    std::mutex _pending_mutex;
+    std::vector<int> _pending_socks;
+
+    std::shared_ptr<completion_mailbox> _mailbox;
+
+    int64_t _now = 0;
+    timer_wheel _timers;
+
+    header_cache _headers;
+
+    buffer_pool _buffers;
+    object_pool<connection> _connections;
+    object_pool<request_state_machine> _request_state_machines;
+    object_pool<response_reader> _response_readers;
+
+    // connections that spent their budget and wait for a next loop turn
+    connection* _queue_head = nullptr;
+    connection* _queue_tail = nullptr;
+
+    connection* _open_head = nullptr;
 };
 
 }
@@ -40,7 +40,7 @@ int main()
             // server will response 403
             return 400;
         } else if (value.compare("ignore_me")) {
-            // server will save the header into response::headers
+            // server will save the header into request::header_fields
             return -1;
         } else {
             // server will not save the header
@@ -60,7 +60,7 @@ int main()
         std::cout << "handling request " << cxt->id << std::endl << std::flush;
 
         if (req->method == http::request_method::post) {
-            std::string data(req->body_buff->data(), req->body_buff->size());
+            std::string data(req->body_buff.data(), req->body_buff.size());
             if (data == "hello") {
                 resp.code = 200;
             } else {
@@ -6,3 +6,10 @@ int64_t datetime::unix_timestamp()
 {
     return std::time(nullptr);
 }
+
+int64_t datetime::monotonic_msecs()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec)*1000 + ts.tv_nsec/1000000;
+}
@@ -7,6 +7,8 @@ class datetime
 {
 public:
     static int64_t unix_timestamp();
+    // milliseconds of a monotonic clock, only differences make sense
+    static int64_t monotonic_msecs();
 };
 
 #endif // DATETIME_H